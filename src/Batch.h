@@ -0,0 +1,157 @@
+#pragma once
+#include <map>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Executor.h"
+#include "Lockstep.h"
+
+namespace EasyBonsai
+{
+	template <typename Register = std::uint32_t> struct BatchResult
+	{
+		bool success = false;
+		std::uint32_t trap = 0;
+		std::uint64_t steps = 0;
+		std::vector<Register> registers;
+	};
+
+	/*
+		Runs one loaded program over many inputs, the executor is only read so all workers share the decoded program.
+		Every input is a list of (address, value) pairs, addresses the program does not use are kept as they are.
+	*/
+	template <typename Register = std::uint32_t> class BasicBatch
+	{
+	private:
+		const BasicExecutor<Register> &executor;
+		std::vector<std::uint32_t> columns;
+		std::size_t threadCount;
+		std::size_t lanes = 0;
+
+	public:
+		BasicBatch(const BasicExecutor<Register> &executor, std::size_t threadCount = std::thread::hardware_concurrency()) : executor(executor), threadCount(threadCount ? threadCount : 1)
+		{
+			columns = executor.getAddresses();
+		}
+		/*
+			Runs 8 or 16 inputs at once per worker, 0 runs every input on its own.
+		*/
+		void setLockstep(std::size_t width)
+		{
+			lanes = (width == 8 || width == 16) ? width : 0;
+		}
+		/*
+			The register file holds the slots of the program followed by every input column the program does not use.
+		*/
+		std::vector<std::uint32_t> getLayout(const std::vector<std::uint32_t> &inputColumns) const
+		{
+			auto rtn = columns;
+			for (auto address : inputColumns)
+			{
+				if (!executor.findSlot(address) && std::find(rtn.begin(), rtn.end(), address) == rtn.end())
+					rtn.push_back(address);
+			}
+			return rtn;
+		}
+		/*
+			The addresses the values of each result belong to, in the same order.
+		*/
+		std::vector<std::uint32_t> getColumns(const std::vector<std::uint32_t> &inputColumns) const
+		{
+			auto rtn = getLayout(inputColumns);
+			std::sort(rtn.begin(), rtn.end());
+			return rtn;
+		}
+		/*
+			Results are in the order of the inputs, no matter which worker ran them.
+		*/
+		std::vector<BatchResult<Register>> run(const std::vector<std::uint32_t> &inputColumns, const std::vector<std::vector<Register>> &inputs) const
+		{
+			std::vector<BatchResult<Register>> rtn(inputs.size());
+			auto layout = getLayout(inputColumns);
+			auto outputColumns = getColumns(inputColumns);
+
+			std::vector<std::size_t> order;
+			for (auto address : outputColumns)
+			{
+				order.push_back(std::find(layout.begin(), layout.end(), address) - layout.begin());
+			}
+
+			/*
+				Input columns are resolved to slots once, values for unused addresses go behind the register file.
+			*/
+			std::vector<std::uint32_t> targets;
+			for (auto address : inputColumns)
+			{
+				auto slot = executor.findSlot(address);
+				targets.push_back(slot ? *slot : static_cast<std::uint32_t>(std::find(layout.begin(), layout.end(), address) - layout.begin()));
+			}
+
+			/*
+				Workers take groups of inputs, one input each or one per lane.
+			*/
+			auto group = lanes ? lanes : 1;
+			std::atomic<std::size_t> next{0};
+			auto work = [&]() {
+				std::vector<std::vector<Register>> registerFiles;
+				std::vector<std::uint64_t> steps;
+				std::vector<std::uint32_t> traps;
+
+				for (auto first = next.fetch_add(group); inputs.size() > first; first = next.fetch_add(group))
+				{
+					auto count = std::min(group, inputs.size() - first);
+					registerFiles.assign(count, executor.getRegisterFile());
+					for (std::size_t i = 0; count > i; i++)
+					{
+						const auto &input = inputs[first + i];
+						registerFiles[i].resize(layout.size(), 0);
+						for (std::size_t column = 0; input.size() > column && targets.size() > column; column++)
+						{
+							registerFiles[i][targets[column]] = input[column];
+						}
+					}
+
+					if (lanes == 16)
+						Lockstep<16, Register>(executor).run(registerFiles, steps, traps);
+					else if (lanes == 8)
+						Lockstep<8, Register>(executor).run(registerFiles, steps, traps);
+					else
+					{
+						steps.assign(1, 0);
+						traps.assign(1, executor.runShared(registerFiles[0], steps[0]));
+					}
+
+					for (std::size_t i = 0; count > i; i++)
+					{
+						auto &result = rtn[first + i];
+						result.steps = steps[i];
+						result.trap = traps[i];
+						result.success = result.trap == 0;
+						for (auto slot : order)
+						{
+							result.registers.push_back(registerFiles[i][slot]);
+						}
+					}
+				}
+			};
+
+			std::vector<std::thread> workers;
+			auto groups = (inputs.size() + group - 1) / group;
+			for (std::size_t i = 1; std::min(threadCount, groups) > i; i++)
+			{
+				workers.emplace_back(work);
+			}
+			work();
+
+			for (auto &worker : workers)
+			{
+				worker.join();
+			}
+			return rtn;
+		}
+	};
+	using Batch = BasicBatch<>;
+} // namespace EasyBonsai
@@ -0,0 +1,329 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include "Operation.h"
+
+#ifndef BONSAI_WEB
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#endif
+
+namespace EasyBonsai
+{
+	namespace internal
+	{
+		inline const char binaryMagic[4] = {'B', 'O', 'N', 'B'};
+		inline const std::uint32_t binaryVersion = 1;
+		inline const std::size_t binaryHeaderSize = 32;
+
+		/*
+			FNV-1a over 8 byte words, the bytes that do not fill a word are added one by one.
+		*/
+		inline std::uint64_t checksum(const std::uint8_t *data, std::size_t size)
+		{
+			std::uint64_t hash = 14695981039346656037ull;
+			std::size_t offset = 0;
+			for (; size >= offset + 8; offset += 8)
+			{
+				std::uint64_t word;
+				std::memcpy(&word, data + offset, 8);
+				hash ^= word;
+				hash *= 1099511628211ull;
+			}
+			for (; size > offset; offset++)
+			{
+				hash ^= data[offset];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	} // namespace internal
+
+	/*
+		A compiled program laid out as:
+			"BONB", version, checksum (u64) of everything behind it, program hash (u64), line count, register count
+			address of every register slot
+			one (opcode, operand) record per line, operands of tst/inc/dec are slots and jmp operands are lines
+		All values are little endian. The program hash is the one of the text the program was compiled to, so hints and checkpoints work for both.
+		BinaryProgram only points into the bytes it was parsed from.
+	*/
+	class BinaryProgram
+	{
+	private:
+		const std::uint8_t *data = nullptr;
+		std::uint64_t programHash = 0;
+		std::uint32_t lineCount = 0;
+		std::uint32_t registerCount = 0;
+
+	private:
+		std::uint32_t read32(std::size_t offset) const
+		{
+			std::uint32_t rtn;
+			std::memcpy(&rtn, data + offset, 4);
+			return rtn;
+		}
+
+	public:
+		/*
+			Returns nothing if the bytes are not a program of this version or the checksum does not match.
+		*/
+		static std::optional<BinaryProgram> parse(const std::uint8_t *data, std::size_t size)
+		{
+			if (size < internal::binaryHeaderSize || std::memcmp(data, internal::binaryMagic, 4) != 0)
+				return std::nullopt;
+
+			BinaryProgram rtn;
+			rtn.data = data;
+
+			std::uint64_t checksum;
+			std::memcpy(&checksum, data + 8, 8);
+			std::memcpy(&rtn.programHash, data + 16, 8);
+			rtn.lineCount = rtn.read32(24);
+			rtn.registerCount = rtn.read32(28);
+
+			if (rtn.read32(4) != internal::binaryVersion)
+				return std::nullopt;
+			if (size != internal::binaryHeaderSize + static_cast<std::size_t>(rtn.registerCount) * 4 + static_cast<std::size_t>(rtn.lineCount) * 8)
+				return std::nullopt;
+			if (internal::checksum(data + 16, size - 16) != checksum)
+				return std::nullopt;
+
+			return rtn;
+		}
+		static bool isBinary(const std::uint8_t *data, std::size_t size)
+		{
+			return size >= 4 && std::memcmp(data, internal::binaryMagic, 4) == 0;
+		}
+		std::uint64_t getProgramHash() const
+		{
+			return programHash;
+		}
+		std::uint32_t getLineCount() const
+		{
+			return lineCount;
+		}
+		std::uint32_t getRegisterCount() const
+		{
+			return registerCount;
+		}
+		std::uint32_t getAddress(std::uint32_t slot) const
+		{
+			return read32(internal::binaryHeaderSize + static_cast<std::size_t>(slot) * 4);
+		}
+		std::pair<Opcode, std::uint32_t> getRecord(std::uint32_t line) const
+		{
+			auto offset = internal::binaryHeaderSize + static_cast<std::size_t>(registerCount) * 4 + static_cast<std::size_t>(line) * 8;
+			return {static_cast<Opcode>(read32(offset)), read32(offset + 4)};
+		}
+	};
+
+	/*
+		operations are the decoded lines without the end markers, out of bounds jumps (traps) are stored as jumps to lineCount.
+	*/
+	inline std::vector<std::uint8_t> serializeBinary(std::uint64_t programHash, const std::vector<std::uint32_t> &addresses, const std::vector<Operation> &operations)
+	{
+		std::vector<std::uint8_t> rtn(internal::binaryHeaderSize + addresses.size() * 4 + operations.size() * 8, 0);
+		auto write32 = [&](std::size_t offset, std::uint32_t value) { std::memcpy(rtn.data() + offset, &value, 4); };
+
+		auto lineCount = static_cast<std::uint32_t>(operations.size());
+		std::memcpy(rtn.data(), internal::binaryMagic, 4);
+		write32(4, internal::binaryVersion);
+		std::memcpy(rtn.data() + 16, &programHash, 8);
+		write32(24, lineCount);
+		write32(28, static_cast<std::uint32_t>(addresses.size()));
+
+		auto offset = internal::binaryHeaderSize;
+		for (auto address : addresses)
+		{
+			write32(offset, address);
+			offset += 4;
+		}
+		for (const auto &operation : operations)
+		{
+			auto isTrap = operation.opcode == Opcode::TRAP;
+			write32(offset, static_cast<std::uint32_t>(isTrap ? Opcode::JMP : operation.opcode));
+			write32(offset + 4, isTrap ? lineCount : operation.operand);
+			offset += 8;
+		}
+
+		auto checksum = internal::checksum(rtn.data() + 16, rtn.size() - 16);
+		std::memcpy(rtn.data() + 8, &checksum, 8);
+		return rtn;
+	}
+	/*
+		Turns a binary program back into text, only needed where lines are shown.
+	*/
+	inline std::vector<std::string> disassemble(const BinaryProgram &program)
+	{
+		std::vector<std::string> rtn;
+		for (std::uint32_t line = 0; program.getLineCount() > line; line++)
+		{
+			auto [opcode, operand] = program.getRecord(line);
+			auto address = [&]() { return program.getRegisterCount() > operand ? std::to_string(program.getAddress(operand)) : "?"; };
+			switch (opcode)
+			{
+			case Opcode::TST:
+				rtn.push_back("tst " + address());
+				break;
+			case Opcode::INC:
+				rtn.push_back("inc " + address());
+				break;
+			case Opcode::DEC:
+				rtn.push_back("dec " + address());
+				break;
+			case Opcode::JMP:
+				rtn.push_back("jmp " + std::to_string(operand));
+				break;
+			case Opcode::INT:
+				rtn.push_back("int");
+				break;
+			default:
+				rtn.push_back("hlt");
+				break;
+			}
+		}
+		return rtn;
+	}
+
+	/*
+		Maps a file read only, builds without mmap read it into memory instead.
+	*/
+	class MappedFile
+	{
+	private:
+		const std::uint8_t *data = nullptr;
+		std::size_t size = 0;
+		std::vector<std::uint8_t> buffer;
+#ifndef BONSAI_WEB
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		void *mapped = nullptr;
+#endif
+#endif
+
+	private:
+		void release()
+		{
+#ifndef BONSAI_WEB
+#ifdef _WIN32
+			if (data)
+				UnmapViewOfFile(data);
+			if (mapping)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+			mapping = nullptr;
+#else
+			if (mapped)
+				munmap(mapped, size);
+			mapped = nullptr;
+#endif
+#endif
+			data = nullptr;
+			size = 0;
+			buffer.clear();
+		}
+
+	public:
+		MappedFile() {}
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		~MappedFile()
+		{
+			release();
+		}
+		bool open(const std::string &path)
+		{
+			release();
+#if defined(BONSAI_WEB)
+			std::ifstream input(path, std::ios::binary);
+			if (!input)
+				return false;
+
+			buffer.assign(std::istreambuf_iterator<char>(input), {});
+			data = buffer.data();
+			size = buffer.size();
+			return true;
+#elif defined(_WIN32)
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize))
+			{
+				release();
+				return false;
+			}
+			/* Empty files can not be mapped, they are opened without data */
+			if (fileSize.QuadPart == 0)
+			{
+				release();
+				return true;
+			}
+
+			size = static_cast<std::size_t>(fileSize.QuadPart);
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+				data = static_cast<const std::uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (!data)
+			{
+				release();
+				return false;
+			}
+			return true;
+#else
+			auto descriptor = ::open(path.c_str(), O_RDONLY);
+			if (descriptor < 0)
+				return false;
+
+			struct stat status;
+			if (fstat(descriptor, &status) != 0)
+			{
+				::close(descriptor);
+				return false;
+			}
+			/* Empty files can not be mapped, they are opened without data */
+			if (status.st_size == 0)
+			{
+				::close(descriptor);
+				return true;
+			}
+
+			size = static_cast<std::size_t>(status.st_size);
+			mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			::close(descriptor);
+			if (mapped == MAP_FAILED)
+			{
+				mapped = nullptr;
+				size = 0;
+				return false;
+			}
+
+			data = static_cast<const std::uint8_t *>(mapped);
+			return true;
+#endif
+		}
+		const std::uint8_t *getData() const
+		{
+			return data;
+		}
+		std::size_t getSize() const
+		{
+			return size;
+		}
+	};
+} // namespace EasyBonsai
@@ -0,0 +1,142 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include "Checkpoint.h"
+
+namespace EasyBonsai
+{
+	/*
+		Remembers the result of halted runs on disk, one file per (program, initial registers) pair.
+		A file is "BRES", version, the size of the start checkpoint, the start checkpoint (see getStart) and the result as a checkpoint holding the final registers and the step count.
+		The start checkpoint is compared on load, so a file whose name only collides with the key is never used.
+		The modification time of a file is the time it was last used, so the least recently used results are removed first once the directory grows past the size limit.
+	*/
+	class ResultCache
+	{
+	private:
+		std::filesystem::path directory;
+		std::uintmax_t maxSize;
+
+		static constexpr const char *extension = ".result";
+		static constexpr const char magic[4] = {'B', 'R', 'E', 'S'};
+		static constexpr std::uint32_t version = 1;
+
+	private:
+		std::filesystem::path getFile(const Checkpoint &start) const
+		{
+			char name[17];
+			std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(getKey(start)));
+			return directory / (std::string(name) + extension);
+		}
+
+	public:
+		ResultCache(const std::string &directory, std::uintmax_t maxSize = 64ull << 20) : directory(directory), maxSize(maxSize) {}
+		/*
+			The serialized start checkpoint with the registers sorted by address, so the order they were set in does not matter.
+		*/
+		static std::vector<std::uint8_t> getStart(Checkpoint start)
+		{
+			std::sort(start.registers.begin(), start.registers.end());
+			start.ip = 0;
+			start.steps = 0;
+			return serializeCheckpoint(start);
+		}
+		/*
+			FNV-1a over getStart.
+		*/
+		static std::uint64_t getKey(const Checkpoint &start)
+		{
+			std::uint64_t hash = 14695981039346656037ull;
+			for (auto byte : getStart(start))
+			{
+				hash ^= byte;
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+		/*
+			start is the checkpoint of the loaded program before it ran, returns the checkpoint after it halted if that is known.
+		*/
+		std::optional<Checkpoint> load(const Checkpoint &start) const
+		{
+			auto file = getFile(start);
+			std::ifstream input(file, std::ios::binary);
+			if (!input)
+				return std::nullopt;
+
+			std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(input), {});
+			std::size_t offset = 4;
+			std::uint32_t fileVersion = 0, startSize = 0;
+			if (bytes.size() < 4 || std::memcmp(bytes.data(), magic, 4) != 0 || !internal::read(bytes, offset, fileVersion) || fileVersion != version || !internal::read(bytes, offset, startSize))
+				return std::nullopt;
+
+			auto expected = getStart(start);
+			if (startSize != expected.size() || bytes.size() < offset + startSize || std::memcmp(bytes.data() + offset, expected.data(), startSize) != 0)
+				return std::nullopt;
+
+			auto rtn = parseCheckpoint(std::vector<std::uint8_t>(bytes.begin() + offset + startSize, bytes.end()));
+			if (!rtn || rtn->programHash != start.programHash || rtn->width != start.width)
+				return std::nullopt;
+
+			std::error_code error;
+			std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+			return rtn;
+		}
+		bool store(const Checkpoint &start, Checkpoint result)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+
+			result.ip = 0;
+			auto startBytes = getStart(start);
+			std::vector<std::uint8_t> bytes(magic, magic + 4);
+			internal::append(bytes, version);
+			internal::append(bytes, static_cast<std::uint32_t>(startBytes.size()));
+			bytes.insert(bytes.end(), startBytes.begin(), startBytes.end());
+
+			auto resultBytes = serializeCheckpoint(result);
+			bytes.insert(bytes.end(), resultBytes.begin(), resultBytes.end());
+			if (!internal::replaceFile(getFile(start).string(), bytes))
+				return false;
+
+			evict();
+			return true;
+		}
+		/*
+			Removes the least recently used results until the cache fits into the size limit.
+		*/
+		void evict() const
+		{
+			std::error_code error;
+			std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+			std::uintmax_t size = 0;
+
+			for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+			{
+				if (entry.path().extension() != extension)
+					continue;
+
+				size += entry.file_size(error);
+				files.push_back({entry.last_write_time(error), entry.path()});
+			}
+
+			std::sort(files.begin(), files.end());
+			for (const auto &file : files)
+			{
+				if (maxSize >= size)
+					break;
+
+				auto fileSize = std::filesystem::file_size(file.second, error);
+				if (std::filesystem::remove(file.second, error))
+					size -= std::min(size, fileSize);
+			}
+		}
+	};
+} // namespace EasyBonsai
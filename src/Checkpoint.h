@@ -0,0 +1,188 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <filesystem>
+
+#ifndef BONSAI_WEB
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace EasyBonsai
+{
+	/*
+		Everything needed to continue a run: the program it belongs to, the register width in bits, the line to continue at, the steps so far and every register.
+	*/
+	struct Checkpoint
+	{
+		std::uint64_t programHash = 0;
+		std::uint32_t width = 32;
+		std::uint32_t ip = 0;
+		std::uint64_t steps = 0;
+		std::vector<std::pair<std::uint32_t, std::uint64_t>> registers;
+	};
+
+	namespace internal
+	{
+		inline const char checkpointMagic[4] = {'B', 'C', 'H', 'K'};
+		inline const std::uint32_t checkpointVersion = 2;
+
+		template <typename T> void append(std::vector<std::uint8_t> &output, T value)
+		{
+			auto bytes = reinterpret_cast<const std::uint8_t *>(&value);
+			output.insert(output.end(), bytes, bytes + sizeof(T));
+		}
+		template <typename T> bool read(const std::vector<std::uint8_t> &input, std::size_t &offset, T &value)
+		{
+			if (input.size() < offset + sizeof(T))
+				return false;
+
+			std::memcpy(&value, input.data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+	} // namespace internal
+
+	/*
+		"BCHK", version, program hash, register width, ip, steps, register count and (address, value) pairs, all little endian.
+		Values are 64 bit, version 1 had no width and 32 bit values and is still read.
+	*/
+	inline std::vector<std::uint8_t> serializeCheckpoint(const Checkpoint &checkpoint)
+	{
+		std::vector<std::uint8_t> rtn(internal::checkpointMagic, internal::checkpointMagic + 4);
+		rtn.reserve(36 + checkpoint.registers.size() * 12);
+
+		internal::append(rtn, internal::checkpointVersion);
+		internal::append(rtn, checkpoint.programHash);
+		internal::append(rtn, checkpoint.width);
+		internal::append(rtn, checkpoint.ip);
+		internal::append(rtn, checkpoint.steps);
+		internal::append(rtn, static_cast<std::uint32_t>(checkpoint.registers.size()));
+		for (const auto &reg : checkpoint.registers)
+		{
+			internal::append(rtn, reg.first);
+			internal::append(rtn, reg.second);
+		}
+		return rtn;
+	}
+	inline std::optional<Checkpoint> parseCheckpoint(const std::vector<std::uint8_t> &input)
+	{
+		if (input.size() < 4 || std::memcmp(input.data(), internal::checkpointMagic, 4) != 0)
+			return std::nullopt;
+
+		Checkpoint rtn;
+		std::size_t offset = 4;
+		std::uint32_t version = 0, count = 0;
+		if (!internal::read(input, offset, version) || (version != 1 && version != internal::checkpointVersion))
+			return std::nullopt;
+		if (!internal::read(input, offset, rtn.programHash) || (version > 1 && !internal::read(input, offset, rtn.width)))
+			return std::nullopt;
+		if (!internal::read(input, offset, rtn.ip) || !internal::read(input, offset, rtn.steps) || !internal::read(input, offset, count))
+			return std::nullopt;
+
+		std::size_t valueSize = version > 1 ? 8 : 4;
+		if (input.size() != offset + static_cast<std::size_t>(count) * (4 + valueSize))
+			return std::nullopt;
+
+		for (std::uint32_t i = 0; count > i; i++)
+		{
+			std::pair<std::uint32_t, std::uint64_t> reg;
+			std::uint32_t value = 0;
+			internal::read(input, offset, reg.first);
+			if (version > 1)
+				internal::read(input, offset, reg.second);
+			else if (internal::read(input, offset, value))
+				reg.second = value;
+			rtn.registers.push_back(reg);
+		}
+		return rtn;
+	}
+	namespace internal
+	{
+		/*
+			Writes into a temporary file first and renames it over file afterwards, so an interrupted write leaves the old content in place.
+			The temporary file is synced to the disk before the rename and the rename is synced afterwards (the directory on POSIX, write through on Windows).
+			Once true is returned the new content survives a crash or power loss, as far as the disk keeps what it reports as written. The web build only renames.
+		*/
+		inline bool replaceFile(const std::string &file, const std::vector<std::uint8_t> &bytes)
+		{
+			auto temporary = file + ".tmp";
+#if defined(BONSAI_WEB)
+			{
+				std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+				output.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+				output.flush();
+				if (!output)
+					return false;
+			}
+
+			std::error_code error;
+			std::filesystem::rename(temporary, file, error);
+			return !error;
+#elif defined(_WIN32)
+			auto handle = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE)
+				return false;
+
+			DWORD written = 0;
+			auto success = WriteFile(handle, bytes.data(), static_cast<DWORD>(bytes.size()), &written, nullptr) && written == bytes.size() && FlushFileBuffers(handle);
+			CloseHandle(handle);
+
+			return success && MoveFileExA(temporary.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+			auto descriptor = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (descriptor < 0)
+				return false;
+
+			std::size_t offset = 0;
+			while (bytes.size() > offset)
+			{
+				auto count = ::write(descriptor, bytes.data() + offset, bytes.size() - offset);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					break;
+				offset += static_cast<std::size_t>(count);
+			}
+			auto success = offset == bytes.size() && ::fsync(descriptor) == 0;
+			success = ::close(descriptor) == 0 && success;
+			if (!success || ::rename(temporary.c_str(), file.c_str()) != 0)
+				return false;
+
+			auto directory = std::filesystem::path(file).parent_path();
+			auto directoryDescriptor = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+			if (directoryDescriptor < 0)
+				return false;
+
+			auto synced = ::fsync(directoryDescriptor) == 0;
+			::close(directoryDescriptor);
+			return synced;
+#endif
+		}
+	} // namespace internal
+
+	/*
+		Replaces file with the checkpoint, see internal::replaceFile for what is guaranteed once true is returned.
+	*/
+	inline bool writeCheckpoint(const std::string &file, const Checkpoint &checkpoint)
+	{
+		return internal::replaceFile(file, serializeCheckpoint(checkpoint));
+	}
+	inline std::optional<Checkpoint> readCheckpoint(const std::string &file)
+	{
+		std::ifstream input(file, std::ios::binary);
+		if (!input)
+			return std::nullopt;
+
+		return parseCheckpoint(std::vector<std::uint8_t>(std::istreambuf_iterator<char>(input), {}));
+	}
+} // namespace EasyBonsai
@@ -1,9 +1,18 @@
 #pragma once
 #include <map>
-#include <regex>
+#include <set>
 #include <array>
 #include <string>
 #include <vector>
+#include <variant>
+#include <optional>
+#include <unordered_map>
+#include <limits>
+#include <cstdlib>
+#include <numeric>
+#include <algorithm>
+#include "Hints.h"
+#include "Lexer.h"
 #include "belegpp/belegpp.h"
 using namespace beleg::helpers::print;
 using namespace beleg::extensions::strings;
@@ -11,235 +20,202 @@ using namespace beleg::extensions::containers;
 
 namespace EasyBonsai
 {
-	namespace internal
+	enum class IrOpcode
 	{
-		class CommandCollection
-		{
-			struct Command
-			{
-				std::regex regex;
-				std::uint32_t argCount;
-				bool isUseableAddy = true;
-				std::vector<std::uint32_t> ignoredAddys;
-			};
+		TST,
+		JMP,
+		INC,
+		DEC,
+		HLT,
+		INT,
+		MOV,
+		MOVN,
+		ADD,
+		SUB,
+		VINC,
+		VDEC,
+		CMP,
+		AND,
+		OR,
+		JE,
+		JNE,
+		JL,
+		JG,
+		GOTO,
+		JMPTO,
+		JMPR,
+		REG,
+		REGA,
+		LABELN,
+		LABEL,
+		FUNCDEF,
+		PUSH,
+		CALL,
+		RET,
+		RETV,
+		TEXT
+	};
+	/*
+		A jump target or label the compiler still moves when lines in front of it are removed, it indexes the references of the compiler and is resolved once the code is laid out.
+	*/
+	struct IrReference
+	{
+		std::size_t index;
+	};
+	/*
+		Lines calculated by the compiler are numbers, everything taken from the source (registers, labels and jump targets) keeps its spelling so it is printed exactly as it was written.
+	*/
+	using IrOperand = std::variant<std::int64_t, std::string, IrReference>;
+	/*
+		One instruction of the compiled code, sourceLine is the line it was parsed from or expanded out of.
+		Declarations, functions and their calls are parsed before everything else and are gone once the code is laid out.
+		Lines that name registers are only an instruction once the names are replaced, they are kept as TEXT until then and lines that are no instruction the compiler lowers are printed unchanged.
+	*/
+	struct IrInstruction
+	{
+		IrOpcode opcode;
+		std::array<IrOperand, 2> operands{};
+		std::uint32_t sourceLine = 0;
+	};
 
+	class Compiler
+	{
+		struct Function
+		{
+			std::string name;
+			std::vector<IrInstruction> code;
+			std::vector<std::string> params;
+			/* Lines that do not name a parameter are the same on every call and are stored already parsed, the others are kept as text */
+			std::vector<bool> usesParams;
+		};
+		/*
+			A label or a jump to a number, value is the line it points at or for relative jumps the offset from line, the instruction of the jump.
+			It moves past the removals that happened after it was written (since), jumps of the source keep the line they were written as (written) as long as they did not move.
+		*/
+		struct Reference
+		{
+			bool relative;
+			std::int64_t value;
+			std::string written;
+			std::size_t line;
+			std::size_t since;
+		};
+		/*
+			Lines removed from the code at once, deletedBefore[i] is the amount of removed lines in front of line i and positions holds the line every instruction was on before.
+		*/
+		struct Removal
+		{
+			std::vector<std::int64_t> deletedBefore;
+			std::vector<std::int64_t> positions;
+			std::size_t count;
+		};
+		/*
+			Names and what they are replaced with, in the order the replacements are applied.
+			Every name is interned once, a line is split into words once and each word is resolved with one hash lookup.
+		*/
+		class SymbolTable
+		{
 		private:
-			std::vector<Command> commands;
+			std::vector<std::pair<std::string, std::string>> symbols;
+			std::unordered_map<std::string, std::vector<std::size_t>> indices;
 
-		public:
-			CommandCollection(std::vector<Command> commands) : commands(commands)
-			{
-			}
-			bool matchesAny(const std::string &what)
-			{
-				for (auto command : commands)
-				{
-					if (std::regex_match(what, command.regex))
-					{
-						return true;
-					}
-				}
-				return false;
-			}
-			std::optional<Command> getMatching(const std::string &what)
-			{
-				for (auto command : commands)
-				{
-					if (std::regex_match(what, command.regex))
-					{
-						return command;
-					}
-				}
-				return std::nullopt;
-			}
-			template <std::size_t instruction>
-			bool matches(const std::string &what)
-			{
-				if (std::regex_match(what, commands.at(instruction).regex))
-				{
-					return true;
-				}
-				return false;
-			}
-			template <typename ReturnType = std::string, std::enable_if_t<std::is_arithmetic<ReturnType>::value || std::is_same<std::string, ReturnType>::value> * = nullptr>
-			std::vector<ReturnType> getUsedAddys(const std::string &what)
+		private:
+			void lookup(const std::string &line, std::size_t from, std::set<std::size_t> &pending) const
 			{
-				std::smatch res;
-				std::vector<ReturnType> rtn;
+				if (indices.empty())
+					return;
 
-				for (auto command : commands)
+				for (const auto &word : line | split(" "))
 				{
-					if (!command.isUseableAddy)
+					auto found = indices.find((word | trim()) | replace(",", ""));
+					if (found == indices.end())
 						continue;
 
-					if (std::regex_match(what, res, command.regex))
+					for (auto index : found->second)
 					{
-						for (std::size_t i = 1; command.argCount >= i; i++)
-						{
-							if (command.ignoredAddys | contains(i))
-								continue;
-							if constexpr (std::is_arithmetic<ReturnType>::value)
-							{
-								if (std::regex_match(res[i].str(), std::regex(R"r(-?[0-9]+)r")))
-									rtn.push_back(std::stoi(res[i]));
-							}
-							else
-							{
-								rtn.push_back(res[i]);
-							}
-						}
+						if (index >= from)
+							pending.insert(index);
 					}
 				}
+			}
 
-				return rtn;
+		public:
+			void add(const std::string &name, const std::string &value)
+			{
+				indices[name].push_back(symbols.size());
+				symbols.push_back({name, value});
 			}
-			template <std::size_t instruction, std::size_t count, typename ReturnType = std::string, std::enable_if_t<std::is_arithmetic<ReturnType>::value || std::is_same<std::string, ReturnType>::value> * = nullptr>
-			std::array<ReturnType, count> getArguments(const std::string &what)
+			bool uses(const std::string &line) const
 			{
-				std::smatch res;
-				std::array<ReturnType, count> rtn;
-
-				if (std::regex_match(what, res, commands.at(instruction).regex))
-				{
-					for (int i = 1; count >= i; i++)
-					{
-						if constexpr (std::is_arithmetic<ReturnType>::value)
-						{
-							rtn[i - 1] = std::stoi(res[i]);
-						}
-						else
-						{
-							rtn[i - 1] = res[i];
-						}
-					}
-				}
-				return rtn;
+				std::set<std::size_t> pending;
+				lookup(line, 0, pending);
+				return !pending.empty();
 			}
-			template <std::size_t count, typename ReturnType = std::string, std::enable_if_t<std::is_arithmetic<ReturnType>::value || std::is_same<std::string, ReturnType>::value> * = nullptr>
-			std::array<ReturnType, count> getArguments(const std::string &what)
+			/*
+				Returns line as if every name had been replaced one after another, replacements only touch lines that use their name.
+				onReplace(index, line) is called with the line as it was before each replacement.
+			*/
+			template <typename Callback> std::string substitute(std::string line, Callback &&onReplace) const
 			{
-				std::smatch res;
-				std::array<ReturnType, count> rtn;
+				std::set<std::size_t> pending;
+				lookup(line, 0, pending);
 
-				for (auto command : commands)
+				while (!pending.empty())
 				{
-					if (command.argCount != count)
+					auto index = *pending.begin();
+					pending.erase(pending.begin());
+
+					const auto &symbol = symbols[index];
+					if (!usesVariable(line, symbol.first))
 						continue;
 
-					if (std::regex_match(what, res, command.regex))
-					{
-						for (int i = 1; count >= i; i++)
-						{
-							if constexpr (std::is_arithmetic<ReturnType>::value)
-							{
-								rtn[i - 1] = std::stoi(res[i]);
-							}
-							else
-							{
-								rtn[i - 1] = res[i];
-							}
-						}
-						break;
-					}
+					onReplace(index, line);
+					line = formatAndReplace(line, symbol.first, symbol.second);
+					/* The value may be a name that is replaced later */
+					lookup(line, index + 1, pending);
 				}
-
-				return rtn;
+				return line;
+			}
+			std::string substitute(const std::string &line) const
+			{
+				return substitute(line, [](std::size_t, const std::string &) {});
 			}
-		};
-	} // namespace internal
-	inline internal::CommandCollection bonsaiRegex({{std::regex(R"r(^tst (\d+)$)r"), 1},
-													{std::regex(R"r(^jmp (\d+)$)r"), 1, false},
-													{std::regex(R"r(^inc (\d+)$)r"), 1},
-													{std::regex(R"r(^dec (\d+)$)r"), 1},
-													{std::regex(R"r(^hlt$)r"), 0, false},
-													{std::regex(R"r(^int$)r"), 0, false}});
-	inline internal::CommandCollection easyBonsaiRegex(
-		{{std::regex(R"r(^([a-zA-Z0-9-_]+):$)r"), 1, false},
-		 {std::regex(R"r(^jg (.+)$)r"), 1, false},
-		 {std::regex(R"r(^goto (.+)$)r"), 1, false},
-		 {std::regex(R"r(^(.+):\ .*$)r"), 1, false},
-		 {std::regex(R"r(^jmp \.(.+)$)r"), 1, false},
-		 {std::regex(R"r(^jmp ([+-]\d+)$)r"), 1, false},
-		 {std::regex(R"r(^je (.+)$)r"), 1, false},
-		 {std::regex(R"r(^jl (.+)$)r"), 1, false},
-		 {std::regex(R"r(^mov (\d+)\ *,\ *NULL$)r"), 1},
-		 {std::regex(R"r(^reg (.+)\ *,\ *(\d+)$)r"), 2},
-		 {std::regex(R"r(^or (\d+)\ *,\ *(\d+)$)r"), 2},
-		 {std::regex(R"r(^cmp (\d+)\ *,\ *(\d+)$)r"), 2},
-		 {std::regex(R"r(^and (\d+)\ *,\ *(\d+)$)r"), 2},
-		 {std::regex(R"r(^mov (\d+),\ *(\d+)\ *$)r"), 2},
-		 {std::regex(R"r(^add (\d+),\ *(\d+)\ *$)r"), 2},
-		 {std::regex(R"r(^sub (\d+),\ *(\d+)\ *$)r"), 2},
-		 {std::regex(R"r(^inc (\d+),\ *(\d+)\ *$)r"), 2, true, {2}},
-		 {std::regex(R"r(^dec (\d+),\ *(\d+)\ *$)r"), 2, true, {2}},
-		 {std::regex(R"r(^jne (.+)$)r"), 1, false},
-		 {std::regex(R"r(^ret$)r"), 0, false},
-		 {std::regex(R"r(^ret (.+)$)r"), 1},
-		 {std::regex(R"r(^\(fun (.+)\(([a-zA-Z0-9, ]*)\):\ *$)r"), 2, false},
-		 {std::regex(R"r(^push (.+)$)r"), 2},
-		 {std::regex(R"r(^call (.+)$)r"), 1, false},
-		 {std::regex(R"r(^reg (.+)\ *$)r"), 1}});
-
-	enum Instruction
-	{
-		LABELN,
-		JG,
-		GOTO,
-		LABEL,
-		JMPTO,
-		JMPR,
-		JE,
-		JL,
-		MOVN,
-		REG,
-		OR,
-		CMP,
-		AND,
-		MOV,
-		ADD,
-		SUB,
-		VINC,
-		VDEC,
-		JNE,
-		RET,
-		RETV,
-		FUNCDEF,
-		PUSH,
-		CALL,
-		REGA,
-		TST = 0,
-		JMP,
-		INC,
-		DEC,
-		HLT,
-		INT
-	};
-
-	class Compiler
-	{
-		struct Function
-		{
-			std::string name;
-			std::vector<std::string> code;
-			std::vector<std::string> params;
 		};
 
 	private:
 		std::vector<std::string> code;
+		std::vector<IrInstruction> instructions;
+		/* Until the code is laid out instructions are never removed, lines holds the ones that are still part of the code in order */
+		std::vector<std::size_t> lines;
+		std::vector<Reference> references;
+		std::vector<Removal> removals;
 
 		std::vector<std::string> errorStack;
+		std::vector<MacroHint> macroHints;
 
 		std::string returnRegister;
 		std::string cmpRegisters[2];
 		std::string helpRegisters[2];
 		std::vector<std::uint32_t> knownAddresses;
-		std::map<std::string, std::uint32_t> definedLabels;
+		std::map<std::string, std::size_t> definedLabels;
 		std::map<std::string, Function> functionDefintions;
 		std::map<std::string, std::uint32_t> customAddresses;
 		std::map<std::string, std::uint32_t> userDesiredVariables;
 
 	private:
-		bool usesVariable(std::string &line, const std::string &variableName)
+		void addMacroHint(MacroKind kind, std::size_t entry, std::size_t functionStart, std::size_t functionSize, const std::string &first, const std::string &second = "")
+		{
+			/*
+				Templates that operate on the same register twice behave differently, those are left to the executor.
+			*/
+			if (kind != MacroKind::ADD && kind != MacroKind::SUB && kind != MacroKind::MOVN && first == second)
+				return;
+
+			auto firstArg = static_cast<std::uint32_t>(std::stoul(first));
+			auto secondArg = static_cast<std::uint32_t>(second.empty() ? 0 : std::stoul(second));
+			macroHints.push_back({kind, static_cast<std::uint32_t>(entry), static_cast<std::uint32_t>(functionStart), static_cast<std::uint32_t>(functionStart + functionSize - 1), static_cast<std::uint32_t>(entry + 1), {firstArg, secondArg}});
+		}
+		static bool usesVariable(const std::string &line, const std::string &variableName)
 		{
 			std::string rtn = "";
 			auto splitted = line | split(" ");
@@ -256,7 +232,7 @@ namespace EasyBonsai
 			}
 			return false;
 		}
-		std::string formatAndReplace(std::string &line, const std::string &variableName, const std::string &variableValue)
+		static std::string formatAndReplace(const std::string &line, const std::string &variableName, const std::string &variableValue)
 		{
 			std::string rtn = "";
 			auto splitted = line | split(" ");
@@ -283,101 +259,453 @@ namespace EasyBonsai
 			}
 			return rtn;
 		}
-		void deleteLines(std::vector<std::size_t> lines)
+		/*
+			Removes lines (ascending) from the code, nothing is renumbered here: the removal is recorded and the references written before it move past it when they are resolved.
+		*/
+		void deleteLines(const std::vector<std::size_t> &toDelete)
 		{
-			for (int it = 0; lines.size() > it; it++)
+			if (toDelete.empty())
+				return;
+
+			Removal removal{std::vector<std::int64_t>(lines.size() + 1, 0), std::vector<std::int64_t>(instructions.size(), -1), toDelete.size()};
+			for (auto line : toDelete)
 			{
-				auto index = lines[it] - it;
+				removal.deletedBefore[line + 1]++;
+			}
+			std::partial_sum(removal.deletedBefore.begin(), removal.deletedBefore.end(), removal.deletedBefore.begin());
 
-				for (const auto &label : definedLabels)
+			std::size_t kept = 0;
+			for (std::size_t i = 0, next = 0; lines.size() > i; i++)
+			{
+				removal.positions[lines[i]] = static_cast<std::int64_t>(i);
+				if (toDelete.size() > next && toDelete[next] == i)
 				{
-					if (label.second >= index)
-					{
-						definedLabels.at(label.first) = label.second - 1;
-					}
+					next++;
+					continue;
 				}
-				for (int i = 0; index > i; i++)
-				{
-					auto &line = code[i];
+				lines[kept++] = lines[i];
+			}
+			lines.resize(kept);
+			removals.push_back(std::move(removal));
+		}
+		/*
+			Where reference points after the removals so far and whether any of them moved it.
+			Labels and absolute jumps that pointed at a removed line end up on the line before it, relative jumps forward on the line after it.
+			Without a line before it both move down once per removed line like they did when the lines were removed one at a time, they wrap around and are out of bounds.
+		*/
+		std::pair<std::int64_t, bool> resolve(const Reference &reference) const
+		{
+			auto value = reference.value;
+			auto moved = false;
+			for (auto index = reference.since; removals.size() > index; index++)
+			{
+				const auto &removal = removals[index];
+				auto size = static_cast<std::int64_t>(removal.deletedBefore.size()) - 1;
+				auto deletedUntil = [&](std::int64_t line) { return removal.deletedBefore[std::clamp<std::int64_t>(line, 0, size)]; };
+				auto deletedUpTo = [&](std::int64_t line) { return size > line && deletedUntil(line + 1) == line + 1; };
 
-					if (easyBonsaiRegex.matches<JMPR>(line))
-					{
-						auto args = easyBonsaiRegex.getArguments<JMPR, 1, std::int32_t>(line);
-						if (args[0] >= 0 && (i + args[0]) > index)
-							line = "jmp +" + std::to_string(args[0] - 1);
-					}
+				std::int64_t shift;
+				if (reference.relative)
+				{
+					/* Backward jumps in front of the first line are out of bounds and stay as they are, also once everything up to their target is removed */
+					auto line = removal.positions[reference.line];
+					auto target = line + value;
+					auto outOfBounds = target < 0 || deletedUntil(target + 1) == target + 1;
+					shift = value >= 0 ? deletedUntil(target) - deletedUntil(line + 1) : (outOfBounds ? 0 : deletedUntil(line) - deletedUntil(target + 1));
+					if (shift > 0)
+						value = value >= 0 ? value - shift : value + shift;
 				}
-				for (int i = 0; code.size() > i; i++)
+				else
 				{
-					auto &line = code[i];
+					/* Targets wrap around as unsigned 32 bit numbers, a negative one would be read as a relative jump */
+					shift = deletedUpTo(value) ? static_cast<std::int64_t>(removal.count) : deletedUntil(value + 1);
+					value = static_cast<std::uint32_t>(value - shift);
+				}
+				moved = moved || shift > 0;
+			}
+			return {value, moved};
+		}
+		std::size_t addReference(bool relative, std::int64_t value, const std::string &written, std::size_t line)
+		{
+			references.push_back({relative, value, written, line, removals.size()});
+			return references.size() - 1;
+		}
+		/*
+			A jump the compiler adds to the line target, line is the instruction it becomes.
+		*/
+		IrInstruction jumpTo(std::int64_t target, std::size_t line)
+		{
+			return {IrOpcode::JMP, {IrReference{addReference(false, target, "", line)}}};
+		}
+		/*
+			The instruction with its target resolved, jumps of the source that did not move are kept as the text they were written as.
+		*/
+		IrInstruction resolveTarget(const IrInstruction &instruction) const
+		{
+			const auto &reference = references[std::get<IrReference>(instruction.operands[0]).index];
+			auto [value, moved] = resolve(reference);
 
-					if (i >= index && easyBonsaiRegex.matches<JMPR>(line))
-					{
-						auto args = easyBonsaiRegex.getArguments<JMPR, 1, std::int32_t>(line);
-						if (args[0] < 0 && (i - std::abs(args[0])) < index)
-							line = "jmp " + std::to_string(args[0] + 1);
-					}
-					else if (std::regex_search(line, std::regex(R"r([0-9]+)r")))
-					{
-						if (bonsaiRegex.matches<JMP>(line))
-						{
-							auto args = bonsaiRegex.getArguments<JMP, 1, std::uint32_t>(line);
-							if (args[0] >= index)
-								line = "jmp " + std::to_string(args[0] - 1);
-						}
-						else if (easyBonsaiRegex.matches<JE>(line))
-						{
-							auto args = easyBonsaiRegex.getArguments<JE, 1, std::uint32_t>(line);
-							if (args[0] >= index)
-								line = "je " + std::to_string(args[0] - 1);
-						}
-						else if (easyBonsaiRegex.matches<JNE>(line))
-						{
-							auto args = easyBonsaiRegex.getArguments<JNE, 1, std::uint32_t>(line);
-							if (args[0] >= index)
-								line = "jne " + std::to_string(args[0] - 1);
-						}
-						else if (easyBonsaiRegex.matches<JL>(line))
-						{
-							auto args = easyBonsaiRegex.getArguments<JL, 1, std::uint32_t>(line);
-							if (args[0] >= index)
-								line = "jl " + std::to_string(args[0] - 1);
-						}
-						else if (easyBonsaiRegex.matches<JG>(line))
-						{
-							auto args = easyBonsaiRegex.getArguments<JG, 1, std::uint32_t>(line);
-							if (args[0] >= index)
-								line = "jg " + std::to_string(args[0] - 1);
-						}
-					}
+			if (!moved && !reference.written.empty())
+				return {IrOpcode::TEXT, {reference.written}, instruction.sourceLine};
+			if (reference.relative)
+				return {IrOpcode::JMPR, {value}, instruction.sourceLine};
+
+			return {instruction.opcode, {std::to_string(value)}, instruction.sourceLine};
+		}
+		/*
+			The line the instruction is written as so far.
+		*/
+		std::string textOf(const IrInstruction &instruction) const
+		{
+			if (std::holds_alternative<IrReference>(instruction.operands[0]))
+				return toText(resolveTarget(instruction));
+
+			return toText(instruction);
+		}
+		template <std::size_t count> static IrInstruction makeInstruction(IrOpcode opcode, const std::array<std::string, count> &args, std::uint32_t sourceLine)
+		{
+			IrInstruction rtn{opcode, {}, sourceLine};
+			for (std::size_t i = 0; count > i; i++)
+			{
+				rtn.operands[i] = args[i];
+			}
+			return rtn;
+		}
+		IrInstruction parse(const std::string &line, std::uint32_t sourceLine)
+		{
+			/* Only the instructions starting with the same word as line can match it */
+			auto mnemonic = line.substr(0, line.find(' '));
+			if (mnemonic == "tst")
+			{
+				if (auto args = bonsaiInstructions.matchArguments<TST, 1>(line))
+					return makeInstruction(IrOpcode::TST, *args, sourceLine);
+			}
+			else if (mnemonic == "jmp")
+			{
+				if (auto args = bonsaiInstructions.matchArguments<JMP, 1>(line))
+					return makeInstruction(IrOpcode::JMP, *args, sourceLine);
+				if (auto args = easyBonsaiInstructions.matchArguments<JMPTO, 1>(line))
+					return makeInstruction(IrOpcode::JMPTO, *args, sourceLine);
+				if (auto args = easyBonsaiInstructions.matchArguments<JMPR, 1>(line))
+					return {IrOpcode::JMPR, {static_cast<std::int64_t>(std::stoi((*args)[0]))}, sourceLine};
+			}
+			else if (mnemonic == "inc")
+			{
+				if (auto args = bonsaiInstructions.matchArguments<INC, 1>(line))
+					return makeInstruction(IrOpcode::INC, *args, sourceLine);
+				if (auto args = easyBonsaiInstructions.matchArguments<VINC, 2>(line))
+					return makeInstruction(IrOpcode::VINC, *args, sourceLine);
+			}
+			else if (mnemonic == "dec")
+			{
+				if (auto args = bonsaiInstructions.matchArguments<DEC, 1>(line))
+					return makeInstruction(IrOpcode::DEC, *args, sourceLine);
+				if (auto args = easyBonsaiInstructions.matchArguments<VDEC, 2>(line))
+					return makeInstruction(IrOpcode::VDEC, *args, sourceLine);
+			}
+			else if (mnemonic == "hlt" || mnemonic == "int")
+			{
+				if (line == mnemonic)
+					return {mnemonic == "hlt" ? IrOpcode::HLT : IrOpcode::INT, {}, sourceLine};
+			}
+			else if (mnemonic == "mov")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<MOV, 2>(line))
+					return makeInstruction(IrOpcode::MOV, *args, sourceLine);
+				if (auto args = easyBonsaiInstructions.matchArguments<MOVN, 1>(line))
+					return makeInstruction(IrOpcode::MOVN, *args, sourceLine);
+			}
+			else if (mnemonic == "add")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<ADD, 2>(line))
+					return makeInstruction(IrOpcode::ADD, *args, sourceLine);
+			}
+			else if (mnemonic == "sub")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<SUB, 2>(line))
+					return makeInstruction(IrOpcode::SUB, *args, sourceLine);
+			}
+			else if (mnemonic == "cmp")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<CMP, 2>(line))
+					return makeInstruction(IrOpcode::CMP, *args, sourceLine);
+			}
+			else if (mnemonic == "and")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<AND, 2>(line))
+					return makeInstruction(IrOpcode::AND, *args, sourceLine);
+			}
+			else if (mnemonic == "or")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<OR, 2>(line))
+					return makeInstruction(IrOpcode::OR, *args, sourceLine);
+			}
+			else if (mnemonic == "je")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<JE, 1>(line))
+					return makeInstruction(IrOpcode::JE, *args, sourceLine);
+			}
+			else if (mnemonic == "jne")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<JNE, 1>(line))
+					return makeInstruction(IrOpcode::JNE, *args, sourceLine);
+			}
+			else if (mnemonic == "jl")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<JL, 1>(line))
+					return makeInstruction(IrOpcode::JL, *args, sourceLine);
+			}
+			else if (mnemonic == "jg")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<JG, 1>(line))
+					return makeInstruction(IrOpcode::JG, *args, sourceLine);
+			}
+			else if (mnemonic == "goto")
+			{
+				if (auto args = easyBonsaiInstructions.matchArguments<GOTO, 1>(line))
+					return makeInstruction(IrOpcode::GOTO, *args, sourceLine);
+			}
+
+			return {IrOpcode::TEXT, {line}, sourceLine};
+		}
+		/*
+			Parses a line that is no declaration, line is the instruction it becomes.
+			Jumps to numbers get a reference, the targets of je, jne, jl and jg are read like std::stoi does so labels are left alone.
+		*/
+		IrInstruction parseStatement(const std::string &text, std::size_t line)
+		{
+			auto mnemonic = text.substr(0, text.find(' '));
+			auto target = text.substr(std::min(mnemonic.size() + 1, text.size()));
+			if (mnemonic == "jmp")
+			{
+				if (easyBonsaiInstructions.matches<JMPR>(text))
+					return {IrOpcode::JMPR, {IrReference{addReference(true, std::stoi(target), text, line)}}};
+
+				std::uint32_t number;
+				if (std::all_of(target.begin(), target.end(), internal::isDigit) && internal::parseNumber(target, number))
+					return {IrOpcode::JMP, {IrReference{addReference(false, number, text, line)}}};
+			}
+			else if (mnemonic == "je" || mnemonic == "jne" || mnemonic == "jl" || mnemonic == "jg")
+			{
+				char *end = nullptr;
+				auto number = std::strtoll(target.c_str(), &end, 10);
+				if (end != target.c_str() && number >= std::numeric_limits<std::int32_t>::min() && number <= std::numeric_limits<std::uint32_t>::max())
+				{
+					auto opcode = mnemonic == "je" ? IrOpcode::JE : (mnemonic == "jne" ? IrOpcode::JNE : (mnemonic == "jl" ? IrOpcode::JL : IrOpcode::JG));
+					return {opcode, {IrReference{addReference(false, static_cast<std::uint32_t>(number), text, line)}}};
 				}
-				code | removeAt(index);
 			}
+			else if (auto args = easyBonsaiInstructions.matchArguments<FUNCDEF, 2>(text))
+			{
+				/* The parameters are kept with everything behind them so the line can be printed again */
+				return {IrOpcode::FUNCDEF, {(*args)[0], text.substr(5 + (*args)[0].size())}};
+			}
+			else if (auto args = easyBonsaiInstructions.matchArguments<PUSH, 1>(text))
+			{
+				return {IrOpcode::PUSH, {(*args)[0]}};
+			}
+			else if (auto args = easyBonsaiInstructions.matchArguments<CALL, 1>(text))
+			{
+				return {IrOpcode::CALL, {(*args)[0]}};
+			}
+
+			return {IrOpcode::TEXT, {text}};
+		}
+		/*
+			Parses a line of the source, registers and labels are only declared there.
+		*/
+		IrInstruction parseDeclaration(const std::string &text, std::size_t line)
+		{
+			/* The value is kept with the spaces in front of it so the line can be printed again */
+			if (auto args = easyBonsaiInstructions.matchArguments<REG, 2>(text))
+				return {IrOpcode::REG, {(*args)[0], text.substr(5 + (*args)[0].size())}};
+			if (auto args = easyBonsaiInstructions.matchArguments<REGA, 1>(text))
+				return {IrOpcode::REGA, {(*args)[0]}};
+			if (auto args = easyBonsaiInstructions.matchArguments<LABELN, 1>(text))
+				return {IrOpcode::LABELN, {(*args)[0]}};
+			if (auto args = easyBonsaiInstructions.matchArguments<LABEL, 1>(text))
+				return {IrOpcode::LABEL, {(*args)[0], text.substr((*args)[0].size() + 2)}};
+
+			return parseStatement(text, line);
+		}
+		/*
+			Parses a line of a function body, ret is read without the spaces around it.
+		*/
+		IrInstruction parseBody(const std::string &text, std::size_t line)
+		{
+			auto trimmed = text | trim();
+			if (easyBonsaiInstructions.matches<RET>(trimmed))
+				return {IrOpcode::RET};
+			if (easyBonsaiInstructions.matches<RETV>(trimmed))
+				return {IrOpcode::RETV, {easyBonsaiInstructions.getArguments<RETV, 1>(text)[0]}};
+
+			return parseStatement(text, line);
+		}
+		/*
+			A parsed line of a function body for the instruction line of a call, its reference is written again at the call.
+		*/
+		IrInstruction instantiate(IrInstruction instruction, std::size_t line)
+		{
+			if (auto reference = std::get_if<IrReference>(&instruction.operands[0]))
+			{
+				auto copy = references[reference->index];
+				copy.line = line;
+				copy.since = removals.size();
+
+				references.push_back(copy);
+				reference->index = references.size() - 1;
+			}
+			return instruction;
+		}
+		/*
+			References are printed by the compiler, they have no text of their own.
+		*/
+		static std::string toText(const IrOperand &operand)
+		{
+			if (auto number = std::get_if<std::int64_t>(&operand))
+				return std::to_string(*number);
+			if (auto text = std::get_if<std::string>(&operand))
+				return *text;
+
+			return "";
+		}
+		static std::string toText(const IrInstruction &instruction)
+		{
+			static const char *mnemonics[] = {"tst", "jmp", "inc", "dec", "hlt", "int", "mov", "mov", "add", "sub", "inc", "dec", "cmp", "and", "or", "je", "jne", "jl", "jg", "goto", "jmp", "jmp"};
+			auto first = toText(instruction.operands[0]);
+			auto second = toText(instruction.operands[1]);
+
+			switch (instruction.opcode)
+			{
+			case IrOpcode::TEXT:
+				return first;
+			case IrOpcode::HLT:
+			case IrOpcode::INT:
+				return mnemonics[static_cast<std::size_t>(instruction.opcode)];
+			case IrOpcode::MOVN:
+				return "mov " + first + ", NULL";
+			case IrOpcode::JMPTO:
+				return "jmp ." + first;
+			case IrOpcode::JMPR:
+				return "jmp " + std::string(std::get<std::int64_t>(instruction.operands[0]) >= 0 ? "+" : "") + first;
+			case IrOpcode::REG:
+				return "reg " + first + "," + second;
+			case IrOpcode::REGA:
+				return "reg " + first;
+			case IrOpcode::LABELN:
+				return first + ":";
+			case IrOpcode::LABEL:
+				return first + ": " + second;
+			case IrOpcode::FUNCDEF:
+				return "(fun " + first + second;
+			case IrOpcode::PUSH:
+				return "push " + first;
+			case IrOpcode::CALL:
+				return "call " + first;
+			case IrOpcode::RET:
+				return "ret";
+			case IrOpcode::RETV:
+				return "ret " + first;
+			case IrOpcode::MOV:
+			case IrOpcode::ADD:
+			case IrOpcode::SUB:
+			case IrOpcode::VINC:
+			case IrOpcode::VDEC:
+			case IrOpcode::CMP:
+			case IrOpcode::AND:
+			case IrOpcode::OR:
+				return std::string(mnemonics[static_cast<std::size_t>(instruction.opcode)]) + " " + first + ", " + second;
+			default:
+				return std::string(mnemonics[static_cast<std::size_t>(instruction.opcode)]) + " " + first;
+			}
+		}
+		/*
+			Whether the instruction is plain bonsai, jumps the compiler calculated may still have gone negative.
+		*/
+		static bool isBonsai(const IrInstruction &instruction)
+		{
+			switch (instruction.opcode)
+			{
+			case IrOpcode::TST:
+			case IrOpcode::INC:
+			case IrOpcode::DEC:
+			case IrOpcode::HLT:
+			case IrOpcode::INT:
+				return true;
+			case IrOpcode::JMP:
+				return !std::holds_alternative<std::int64_t>(instruction.operands[0]) || std::get<std::int64_t>(instruction.operands[0]) >= 0;
+			default:
+				return false;
+			}
+		}
+		/*
+			Resolves every reference and keeps the instructions that are still part of the code, the lowering passes only append lines after this and use line numbers.
+			Declarations that are left because of an error are printed as they were written.
+		*/
+		void layout()
+		{
+			std::vector<IrInstruction> laidOut;
+			laidOut.reserve(lines.size());
+			for (std::uint32_t i = 0; lines.size() > i; i++)
+			{
+				const auto &instruction = instructions[lines[i]];
+				if (std::holds_alternative<IrReference>(instruction.operands[0]))
+					laidOut.push_back(resolveTarget(instruction));
+				else if (instruction.opcode != IrOpcode::TEXT)
+					laidOut.push_back({IrOpcode::TEXT, {toText(instruction)}});
+				else
+					laidOut.push_back(instruction);
+
+				laidOut.back().sourceLine = i;
+			}
+			instructions = std::move(laidOut);
+			lines.clear();
 		}
-		bool isCodeValid()
+		/*
+			Parses the lines that were kept as text once their registers are numbers, all passes after this one work on the instructions and the text is only printed at the end.
+		*/
+		bool parseCode()
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::uint32_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
+				if (instructions[i].opcode != IrOpcode::TEXT)
+					continue;
+
+				auto line = toText(instructions[i]);
+				instructions[i] = parse(line, i);
 
-				if (!(easyBonsaiRegex.matchesAny(line) || bonsaiRegex.matchesAny(line)))
+				if (instructions[i].opcode == IrOpcode::TEXT && !(easyBonsaiInstructions.matchesAny(line) || bonsaiInstructions.matchesAny(line)))
 				{
 					errorStack.push_back(printfs("Unkown instruction \"%s\" in line %u", line.c_str(), i));
 				}
 			}
 			return errorStack.size() == 0;
 		}
+		/*
+			Replaces the instruction at index with a jump to the end of the code, where block is appended.
+		*/
+		void expand(std::size_t index, std::vector<IrInstruction> block)
+		{
+			auto sourceLine = instructions[index].sourceLine;
+			instructions[index] = {IrOpcode::JMP, {static_cast<std::int64_t>(instructions.size())}, sourceLine};
+			for (auto &instruction : block)
+			{
+				instruction.sourceLine = sourceLine;
+			}
+			instructions.insert(instructions.end(), block.begin(), block.end());
+		}
 		void detectUsedAddresses()
 		{
-			for (auto line : code)
+			for (const auto &instruction : instructions)
 			{
+				auto line = toText(instruction);
 				if (usesVariable(line, "eax"))
 				{
 					line = formatAndReplace(line, "eax", "0");
 				}
 
-				auto args = bonsaiRegex.getUsedAddys<std::uint32_t>(line);
-				auto args2 = easyBonsaiRegex.getUsedAddys<std::uint32_t>(line);
+				auto args = bonsaiInstructions.getUsedAddys<std::uint32_t>(line);
+				auto args2 = easyBonsaiInstructions.getUsedAddys<std::uint32_t>(line);
 				args.insert(args.end(), args2.begin(), args2.end());
 
 				if (args.size() > 0)
@@ -414,20 +742,19 @@ namespace EasyBonsai
 			returnRegister = std::to_string(maxRegister + 1);
 			customAddresses.insert({"eax", maxRegister + 1});
 
-			for (int i = 0; code.size() > i; i++)
+			SymbolTable variables;
+			for (auto &var : userDesiredVariables)
 			{
-				auto &line = code[i];
-				for (auto &var : userDesiredVariables)
-				{
-					if (usesVariable(line, var.first))
-					{
-						line = formatAndReplace(line, var.first, std::to_string(var.second));
-					}
-				}
-				if (usesVariable(line, "eax"))
-				{
-					line = formatAndReplace(line, "eax", returnRegister);
-				}
+				variables.add(var.first, std::to_string(var.second));
+			}
+			variables.add("eax", returnRegister);
+
+			for (auto &instruction : instructions)
+			{
+				auto replaced = false;
+				auto line = variables.substitute(toText(instruction), [&](std::size_t, const std::string &) { replaced = true; });
+				if (replaced)
+					instruction = {IrOpcode::TEXT, {line}, instruction.sourceLine};
 			}
 
 #ifndef BONSAI_WEB
@@ -441,11 +768,12 @@ namespace EasyBonsai
 			std::vector<std::size_t> toDelete;
 			bool inFunction = false;
 			Function currentFunction;
+			std::vector<std::string> body;
 
-			for (int i = 0; code.size() > i; i++)
+			for (std::uint32_t i = 0; lines.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<FUNCDEF>(line))
+				const auto &instruction = instructions[lines[i]];
+				if (instruction.opcode == IrOpcode::FUNCDEF)
 				{
 					if (inFunction)
 					{
@@ -453,10 +781,10 @@ namespace EasyBonsai
 						return;
 					}
 
-					auto args = easyBonsaiRegex.getArguments<FUNCDEF, 2>(line);
-					currentFunction.name = args[0];
+					auto definition = toText(instruction.operands[1]);
+					currentFunction.name = toText(instruction.operands[0]);
 
-					auto splitted = args[1] | split(",");
+					auto splitted = definition.substr(1, definition.find(')') - 1) | split(",");
 					for (auto &split : splitted)
 					{
 						if (customAddresses | containsKey(split | trim()) || userDesiredVariables | containsKey(split | trim()))
@@ -472,18 +800,44 @@ namespace EasyBonsai
 				}
 				else if (inFunction)
 				{
+					auto line = textOf(instruction);
 					if ((line | trim()) == ")")
 					{
 						inFunction = false;
 						toDelete.push_back(i);
+
+						SymbolTable params;
+						for (auto &param : currentFunction.params)
+						{
+							params.add(param, param);
+						}
+						for (auto &functionLine : body)
+						{
+							auto usesParams = params.uses(functionLine);
+							currentFunction.usesParams.push_back(usesParams);
+							if (usesParams)
+							{
+								currentFunction.code.push_back({IrOpcode::TEXT, {functionLine}});
+								continue;
+							}
+
+							for (auto &param : currentFunction.params)
+							{
+								functionLine = formatAndReplace(functionLine, param, param);
+							}
+							currentFunction.code.push_back(parseBody(functionLine, 0));
+						}
+
 						functionDefintions.insert({currentFunction.name | trim(), currentFunction});
 						currentFunction.code.clear();
 						currentFunction.params.clear();
+						currentFunction.usesParams.clear();
+						body.clear();
 					}
 					else
 					{
 						toDelete.push_back(i);
-						currentFunction.code.push_back(line);
+						body.push_back(line);
 					}
 				}
 			}
@@ -493,67 +847,75 @@ namespace EasyBonsai
 
 			bool wasPreviousPush = false;
 			std::vector<std::string> pushStack;
-			for (int i = 0; code.size() > i; i++)
+			for (std::uint32_t i = 0; lines.size() > i; i++)
 			{
-				auto &line = code[i];
+				auto opcode = instructions[lines[i]].opcode;
+				auto argument = toText(instructions[lines[i]].operands[0]);
 
-				if (easyBonsaiRegex.matches<PUSH>(line))
+				if (opcode == IrOpcode::PUSH)
 				{
 					wasPreviousPush = true;
-					auto args = easyBonsaiRegex.getArguments<PUSH, 1>(line);
-					pushStack.push_back(args[0]);
+					pushStack.push_back(argument);
 					toDelete.push_back(i);
 				}
-				else if (easyBonsaiRegex.matches<CALL>(line))
+				else if (opcode == IrOpcode::CALL)
 				{
 					wasPreviousPush = false;
-					auto args = easyBonsaiRegex.getArguments<CALL, 1>(line);
-					if (!(functionDefintions | containsKey(args[0] | trim())))
+					if (!(functionDefintions | containsKey(argument | trim())))
 					{
-						errorStack.push_back(printfs("Tried to call non existant function \"%s\" in line %u", args[0].c_str(), i));
+						errorStack.push_back(printfs("Tried to call non existant function \"%s\" in line %u", argument.c_str(), i));
 					}
 					else
 					{
-						auto functionStart = code.size();
-						auto continueExec = std::to_string(i + 1);
-						auto functionInfo = functionDefintions.at(args[0] | trim());
+						auto functionStart = static_cast<std::int64_t>(lines.size());
+						auto continueExec = static_cast<std::int64_t>(i + 1);
+						const auto &functionInfo = functionDefintions.at(argument | trim());
 
-						line = "jmp " + std::to_string(functionStart);
+						instructions[lines[i]] = jumpTo(functionStart, lines[i]);
 
 						if (pushStack.size() != functionInfo.params.size())
 						{
-							errorStack.push_back(printfs("Too few arguments for function \"%s\" provided on function call \"%s\" in line %u", functionInfo.name.c_str(), line.c_str(), i));
+							errorStack.push_back(printfs("Too few arguments for function \"%s\" provided on function call \"%s\" in line %u", functionInfo.name.c_str(), textOf(instructions[lines[i]]).c_str(), i));
 							return;
 						}
 
-						std::vector<std::string> newCode = functionInfo.code;
-						for (int k = 0; newCode.size() > k; k++)
+						/* Lines that name a parameter and the lines ret adds behind the body are formatted for this call and parsed */
+						auto first = instructions.size();
+						std::vector<IrInstruction> newCode = functionInfo.code;
+						for (std::size_t k = 0; newCode.size() > k; k++)
 						{
 							auto &newLine = newCode[k];
-							for (int j = 0; functionInfo.params.size() > j; j++)
+							if (k >= functionInfo.usesParams.size() || functionInfo.usesParams[k])
 							{
-								auto param = functionInfo.params[j];
-								auto paramValue = pushStack[j];
-
-								newLine = formatAndReplace(newLine, param, paramValue);
+								auto text = textOf(newLine);
+								for (std::size_t j = 0; functionInfo.params.size() > j; j++)
+								{
+									text = formatAndReplace(text, functionInfo.params[j], pushStack[j]);
+								}
+								newLine = parseBody(text, first + k);
+							}
+							else
+							{
+								newLine = instantiate(newLine, first + k);
 							}
 
-							if (easyBonsaiRegex.matches<RET>(newLine | trim()))
+							if (newLine.opcode == IrOpcode::RET)
 							{
-								newLine = "jmp " + continueExec;
+								newLine = jumpTo(continueExec, first + k);
 							}
-							else if (easyBonsaiRegex.matches<RETV>(newLine | trim()))
+							else if (newLine.opcode == IrOpcode::RETV)
 							{
-								auto retArg = easyBonsaiRegex.getArguments<RETV, 1>(newLine);
-								std::vector<std::string> returnFunc =
-									{
-										"mov eax, " + retArg[0],
-										"jmp " + continueExec};
-								newLine = "jmp " + std::to_string(code.size() + newCode.size());
-								newCode.insert(newCode.end(), returnFunc.begin(), returnFunc.end());
+								IrInstruction returnValue = {IrOpcode::MOV, {std::string("eax"), newLine.operands[0]}};
+								newLine = jumpTo(functionStart + static_cast<std::int64_t>(newCode.size()), first + k);
+								newCode.push_back(returnValue);
+								newCode.push_back(jumpTo(continueExec, first + newCode.size()));
 							}
 						}
-						code.insert(code.end(), newCode.begin(), newCode.end());
+						for (auto &newLine : newCode)
+						{
+							lines.push_back(instructions.size());
+							instructions.push_back(std::move(newLine));
+						}
 						pushStack.clear();
 					}
 				}
@@ -561,7 +923,7 @@ namespace EasyBonsai
 				{
 					if (wasPreviousPush)
 					{
-						errorStack.push_back(printfs("Expected Call but got \"%s\" in line %u", line.c_str(), i));
+						errorStack.push_back(printfs("Expected Call but got \"%s\" in line %u", textOf(instructions[lines[i]]).c_str(), i));
 						return;
 					}
 					wasPreviousPush = false;
@@ -574,62 +936,59 @@ namespace EasyBonsai
 		{
 			std::vector<std::size_t> toDelete;
 
-			for (int i = 0; code.size() > i; i++)
+			for (std::uint32_t i = 0; lines.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<REG>(line))
+				auto &instruction = instructions[lines[i]];
+				auto name = toText(instruction.operands[0]);
+				if (instruction.opcode == IrOpcode::REG)
 				{
-					auto args = easyBonsaiRegex.getArguments<REG, 2>(line);
-					if (!(customAddresses | containsKey(args[0])) && !(userDesiredVariables | containsKey(args[0])))
+					if (!(customAddresses | containsKey(name)) && !(userDesiredVariables | containsKey(name)))
 					{
-						customAddresses.insert({args[0] | trim(), std::stoi(args[1])});
+						customAddresses.insert({name | trim(), std::stoi(toText(instruction.operands[1]))});
 					}
 					else
 					{
-						errorStack.push_back(printfs("Trying to register variable \"%s\" in line %u but it's already defined", args[0].c_str(), i));
+						errorStack.push_back(printfs("Trying to register variable \"%s\" in line %u but it's already defined", name.c_str(), i));
 						return;
 					}
 					toDelete.push_back(i);
 				}
-				else if (easyBonsaiRegex.matches<REGA>(line))
+				else if (instruction.opcode == IrOpcode::REGA)
 				{
-					auto args = easyBonsaiRegex.getArguments<REGA, 1>(line);
-					if (!(userDesiredVariables | containsKey(args[0])) && !(customAddresses | containsKey(args[0])))
+					if (!(userDesiredVariables | containsKey(name)) && !(customAddresses | containsKey(name)))
 					{
-						userDesiredVariables.insert({args[0], 0});
+						userDesiredVariables.insert({name, 0});
 					}
 					else
 					{
-						errorStack.push_back(printfs("Trying to register variable \"%s\" in line %u but it's already defined", args[0].c_str(), i));
+						errorStack.push_back(printfs("Trying to register variable \"%s\" in line %u but it's already defined", name.c_str(), i));
 						return;
 					}
 					toDelete.push_back(i);
 				}
-				else if (easyBonsaiRegex.matches<LABELN>(line))
+				else if (instruction.opcode == IrOpcode::LABELN)
 				{
-					auto args = easyBonsaiRegex.getArguments<LABELN, 1>(line);
-					if (!(definedLabels | containsKey(args[0])))
+					if (!(definedLabels | containsKey(name)))
 					{
-						definedLabels.insert({args[0], i + 1});
+						definedLabels.insert({name, addReference(false, i + 1, "", lines[i])});
 					}
 					else
 					{
-						errorStack.push_back(printfs("Trying to register label \"%s\" in line %u but it's already defined", args[0].c_str(), i));
+						errorStack.push_back(printfs("Trying to register label \"%s\" in line %u but it's already defined", name.c_str(), i));
 						return;
 					}
 					toDelete.push_back(i);
 				}
-				else if (easyBonsaiRegex.matches<LABEL>(line))
+				else if (instruction.opcode == IrOpcode::LABEL)
 				{
-					auto args = easyBonsaiRegex.getArguments<LABEL, 1>(line);
-					if (!(definedLabels | containsKey(args[0])))
+					if (!(definedLabels | containsKey(name)))
 					{
-						line = line.substr(args[0].size() + 2);
-						definedLabels.insert({args[0], i});
+						definedLabels.insert({name, addReference(false, i, "", lines[i])});
+						instruction = parseStatement(toText(instruction.operands[1]), lines[i]);
 					}
 					else
 					{
-						errorStack.push_back(printfs("Trying to register label \"%s\" in line %u but it's already defined", args[0].c_str(), i));
+						errorStack.push_back(printfs("Trying to register label \"%s\" in line %u but it's already defined", name.c_str(), i));
 						return;
 					}
 				}
@@ -639,360 +998,245 @@ namespace EasyBonsai
 			handleFunctions();
 
 #ifndef BONSAI_WEB
-			Console::debug << "Detected Labels: { " << (definedLabels | join(", ")) << " }" << Console::endl;
+			std::map<std::string, std::uint32_t> labels;
+			for (auto &label : definedLabels)
+			{
+				labels.insert({label.first, static_cast<std::uint32_t>(resolve(references[label.second]).first)});
+			}
+			Console::debug << "Detected Labels: { " << (labels | join(", ")) << " }" << Console::endl;
 			Console::debug << "Detected Address-Macros: { " << (customAddresses | join(", ")) << ", " << (userDesiredVariables | join(", ")) << " }" << Console::endl;
 #endif
 
-			std::vector<std::pair<std::uint32_t, std::string>> originals;
+			SymbolTable variables;
 			for (auto &cAddy : customAddresses)
 			{
-				for (int i = 0; code.size() > i; i++)
-				{
-					auto &line = code[i];
-					if (usesVariable(line, cAddy.first))
-					{
-						originals.push_back({i, line});
-						line = formatAndReplace(line, cAddy.first, std::to_string(cAddy.second));
-					}
-				}
+				variables.add(cAddy.first, std::to_string(cAddy.second));
+			}
+
+			/* Index of the variable, line and the line before the variable was replaced */
+			std::vector<std::tuple<std::size_t, std::uint32_t, std::string>> originals;
+			for (std::uint32_t i = 0; lines.size() > i; i++)
+			{
+				auto &instruction = instructions[lines[i]];
+				auto replaced = false;
+				auto line = variables.substitute(textOf(instruction), [&](std::size_t variable, const std::string &original) {
+					originals.push_back({variable, i, original});
+					replaced = true;
+				});
+				if (replaced)
+					instruction = {IrOpcode::TEXT, {line}};
 			}
+			/* Reported by variable and then by line */
+			std::stable_sort(originals.begin(), originals.end(), [](const auto &left, const auto &right) { return std::get<0>(left) < std::get<0>(right); });
 
-			for (auto &original : originals)
+			for (auto &[variable, index, original] : originals)
 			{
-				auto line = code[original.first];
+				auto line = textOf(instructions[lines[index]]);
 				if (usesVariable(line, "eax"))
 				{
 					line = formatAndReplace(line, "eax", "0");
 				}
 
-				auto easyBonsaiMatch = easyBonsaiRegex.getMatching(line);
-				auto bonsaiMatch = bonsaiRegex.getMatching(line);
+				auto easyBonsaiMatch = easyBonsaiInstructions.getMatching(line);
+				auto bonsaiMatch = bonsaiInstructions.getMatching(line);
 
 				if (!((easyBonsaiMatch.has_value() && easyBonsaiMatch.value().isUseableAddy) || (bonsaiMatch.has_value() && bonsaiMatch.value().isUseableAddy)))
 				{
-					errorStack.push_back(printfs("Variable is used with incompatible instruction \"%s\" in line %u - Original: %s", original.second.c_str(), original.first, line.c_str()));
-					line = original.second;
+					errorStack.push_back(printfs("Variable is used with incompatible instruction \"%s\" in line %u - Original: %s", original.c_str(), index, line.c_str()));
+					line = original;
 				}
 			}
 		}
 		void handleCmpInstruction()
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::size_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<CMP>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<CMP, 2>(line);
-
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-
-					std::vector<std::string> cmpFunc =
-						{
-							/*00*/ "mov " + cmpRegisters[0] + "," + args[0],
-							/*01*/ "mov " + cmpRegisters[1] + "," + args[1],
-							/*02*/ "tst " + args[0], /*start*/
-							/*03*/ "jmp " + std::to_string(functionStart + 5),
-							/*04*/ "jmp " + std::to_string(functionStart + 8),
-							/*05*/ "tst " + args[1], /*xNotNull*/
-							/*06*/ "jmp " + std::to_string(functionStart + 11),
-							/*07*/ "jmp " + std::to_string(functionStart + 19),
-							/*08*/ "tst " + args[1], /*xNull*/
-							/*09*/ "jmp " + std::to_string(functionStart + 14),
-							/*10*/ "jmp " + std::to_string(functionStart + 25),
-							/*11*/ "dec " + args[0], /*yNotNull*/
-							/*12*/ "dec " + args[1],
-							/*13*/ "jmp " + std::to_string(functionStart + 2),
-							/*14*/ "mov " + args[0] + "," + cmpRegisters[0], /*less*/
-							/*15*/ "mov " + args[1] + "," + cmpRegisters[1],
-							/*16*/ "mov " + cmpRegisters[0] + ", NULL",
-							/*17*/ "mov " + cmpRegisters[1] + ", NULL",
-							/*18*/ "jmp " + continueExec,
-							/*19*/ "mov " + args[0] + "," + cmpRegisters[0], /*greater*/
-							/*20*/ "mov " + args[1] + "," + cmpRegisters[1],
-							/*21*/ "mov " + cmpRegisters[0] + ", NULL",
-							/*22*/ "mov " + cmpRegisters[1] + ", NULL",
-							/*23*/ "inc " + cmpRegisters[0],
-							/*24*/ "jmp " + continueExec,
-							/*25*/ "mov " + args[0] + "," + cmpRegisters[0], /*equal*/
-							/*26*/ "mov " + args[1] + "," + cmpRegisters[1],
-							/*27*/ "mov " + cmpRegisters[0] + ", NULL",
-							/*28*/ "mov " + cmpRegisters[1] + ", NULL",
-							/*29*/ "inc " + cmpRegisters[1],
-							/*30*/ "jmp " + continueExec};
-					code.insert(code.end(), cmpFunc.begin(), cmpFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<JE>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<JE, 1>(line);
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> jeFunc =
-						{
-							"tst " + cmpRegisters[1],
-							"jmp " + args[0],
-							"jmp " + continueExec};
-					code.insert(code.end(), jeFunc.begin(), jeFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<JNE>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<JNE, 1>(line);
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
+				auto opcode = instructions[i].opcode;
+				auto args = instructions[i].operands;
+				auto functionStart = static_cast<std::int64_t>(instructions.size());
+				auto continueExec = static_cast<std::int64_t>(i + 1);
 
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> jneFunc =
-						{
-							"tst " + cmpRegisters[1],
-							"jmp " + continueExec,
-							"jmp " + args[0]};
-					code.insert(code.end(), jneFunc.begin(), jneFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<JL>(line))
+				if (opcode == IrOpcode::CMP)
 				{
-					auto args = easyBonsaiRegex.getArguments<JL, 1>(line);
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> jlFunc =
+					std::vector<IrInstruction> cmpFunc =
 						{
-							"tst " + cmpRegisters[0],
-							"jmp " + continueExec,
-							"jmp " + args[0]};
-					code.insert(code.end(), jlFunc.begin(), jlFunc.end());
+							/*00*/ {IrOpcode::MOV, {cmpRegisters[0], args[0]}},
+							/*01*/ {IrOpcode::MOV, {cmpRegisters[1], args[1]}},
+							/*02*/ {IrOpcode::TST, {args[0]}}, /*start*/
+							/*03*/ {IrOpcode::JMP, {functionStart + 5}},
+							/*04*/ {IrOpcode::JMP, {functionStart + 8}},
+							/*05*/ {IrOpcode::TST, {args[1]}}, /*xNotNull*/
+							/*06*/ {IrOpcode::JMP, {functionStart + 11}},
+							/*07*/ {IrOpcode::JMP, {functionStart + 19}},
+							/*08*/ {IrOpcode::TST, {args[1]}}, /*xNull*/
+							/*09*/ {IrOpcode::JMP, {functionStart + 14}},
+							/*10*/ {IrOpcode::JMP, {functionStart + 25}},
+							/*11*/ {IrOpcode::DEC, {args[0]}}, /*yNotNull*/
+							/*12*/ {IrOpcode::DEC, {args[1]}},
+							/*13*/ {IrOpcode::JMP, {functionStart + 2}},
+							/*14*/ {IrOpcode::MOV, {args[0], cmpRegisters[0]}}, /*less*/
+							/*15*/ {IrOpcode::MOV, {args[1], cmpRegisters[1]}},
+							/*16*/ {IrOpcode::MOVN, {cmpRegisters[0]}},
+							/*17*/ {IrOpcode::MOVN, {cmpRegisters[1]}},
+							/*18*/ {IrOpcode::JMP, {continueExec}},
+							/*19*/ {IrOpcode::MOV, {args[0], cmpRegisters[0]}}, /*greater*/
+							/*20*/ {IrOpcode::MOV, {args[1], cmpRegisters[1]}},
+							/*21*/ {IrOpcode::MOVN, {cmpRegisters[0]}},
+							/*22*/ {IrOpcode::MOVN, {cmpRegisters[1]}},
+							/*23*/ {IrOpcode::INC, {cmpRegisters[0]}},
+							/*24*/ {IrOpcode::JMP, {continueExec}},
+							/*25*/ {IrOpcode::MOV, {args[0], cmpRegisters[0]}}, /*equal*/
+							/*26*/ {IrOpcode::MOV, {args[1], cmpRegisters[1]}},
+							/*27*/ {IrOpcode::MOVN, {cmpRegisters[0]}},
+							/*28*/ {IrOpcode::MOVN, {cmpRegisters[1]}},
+							/*29*/ {IrOpcode::INC, {cmpRegisters[1]}},
+							/*30*/ {IrOpcode::JMP, {continueExec}}};
+					addMacroHint(MacroKind::CMP, i, functionStart, cmpFunc.size(), toText(args[0]), toText(args[1]));
+					expand(i, cmpFunc);
 				}
-				else if (easyBonsaiRegex.matches<JG>(line))
+				else if (opcode == IrOpcode::JE || opcode == IrOpcode::JNE || opcode == IrOpcode::JL || opcode == IrOpcode::JG)
 				{
-					auto args = easyBonsaiRegex.getArguments<JG, 1>(line);
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> jgFunc =
-						{
-							"tst " + cmpRegisters[0],
-							"jmp " + args[0],
-							"jmp " + continueExec};
-					code.insert(code.end(), jgFunc.begin(), jgFunc.end());
+					/*
+						The destination is taken as written, so it may still be a label or a relative jump that later passes resolve.
+					*/
+					auto destination = parse("jmp " + toText(args[0]), i);
+					IrInstruction next = {IrOpcode::JMP, {continueExec}};
+					auto test = (opcode == IrOpcode::JE || opcode == IrOpcode::JNE) ? cmpRegisters[1] : cmpRegisters[0];
+					auto jumpsIfZero = opcode == IrOpcode::JNE || opcode == IrOpcode::JL;
+
+					expand(i, {{IrOpcode::TST, {test}}, jumpsIfZero ? next : destination, jumpsIfZero ? destination : next});
 				}
 			}
 		}
 		void handleMathInstruction()
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::size_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<SUB>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<SUB, 2>(line);
+				auto opcode = instructions[i].opcode;
+				auto args = instructions[i].operands;
+				auto functionStart = static_cast<std::int64_t>(instructions.size());
+				auto continueExec = static_cast<std::int64_t>(i + 1);
 
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> subFunc =
-						{
-							/*0*/ "mov " + helpRegisters[1] + ", " + args[1],
-							/*1*/ "tst " + helpRegisters[1],
-							/*2*/ "jmp " + std::to_string(functionStart + 4),
-							/*3*/ "jmp " + continueExec,
-							/*4*/ "dec " + args[0],
-							/*4*/ "dec " + helpRegisters[1],
-							/*5*/ "jmp " + std::to_string(functionStart + 1)};
-					code.insert(code.end(), subFunc.begin(), subFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<ADD>(line))
+				if (opcode == IrOpcode::SUB || opcode == IrOpcode::ADD)
 				{
-					auto args = easyBonsaiRegex.getArguments<ADD, 2>(line);
-
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> addFunc =
+					auto isSub = opcode == IrOpcode::SUB;
+					std::vector<IrInstruction> mathFunc =
 						{
-							/*0*/ "mov " + helpRegisters[1] + "," + args[1],
-							/*1*/ "tst " + helpRegisters[1],
-							/*2*/ "jmp " + std::to_string(functionStart + 4),
-							/*3*/ "jmp " + continueExec,
-							/*4*/ "inc " + args[0],
-							/*5*/ "dec " + helpRegisters[1],
-							/*6*/ "jmp " + std::to_string(functionStart + 1)};
-					code.insert(code.end(), addFunc.begin(), addFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<VINC>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<VINC, 2, std::uint32_t>(line);
-
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> incFunc;
-					for (std::uint32_t i = 0; args[1] > i; i++)
-					{
-						incFunc.push_back("inc " + std::to_string(args[0]));
-					}
-					incFunc.push_back("jmp " + continueExec);
-					code.insert(code.end(), incFunc.begin(), incFunc.end());
+							/*0*/ {IrOpcode::MOV, {helpRegisters[1], args[1]}},
+							/*1*/ {IrOpcode::TST, {helpRegisters[1]}},
+							/*2*/ {IrOpcode::JMP, {functionStart + 4}},
+							/*3*/ {IrOpcode::JMP, {continueExec}},
+							/*4*/ {isSub ? IrOpcode::DEC : IrOpcode::INC, {args[0]}},
+							/*5*/ {IrOpcode::DEC, {helpRegisters[1]}},
+							/*6*/ {IrOpcode::JMP, {functionStart + 1}}};
+					addMacroHint(isSub ? MacroKind::SUB : MacroKind::ADD, i, functionStart, mathFunc.size(), toText(args[0]), toText(args[1]));
+					expand(i, mathFunc);
 				}
-				else if (easyBonsaiRegex.matches<VDEC>(line))
+				else if (opcode == IrOpcode::VINC || opcode == IrOpcode::VDEC)
 				{
-					auto args = easyBonsaiRegex.getArguments<VDEC, 2, std::uint32_t>(line);
-
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
+					auto address = std::to_string(static_cast<std::uint32_t>(std::stoi(toText(args[0]))));
+					auto count = static_cast<std::uint32_t>(std::stoi(toText(args[1])));
 
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> decFunc;
-					for (std::uint32_t i = 0; args[1] > i; i++)
-					{
-						decFunc.push_back("dec " + std::to_string(args[0]));
-					}
-					decFunc.push_back("jmp " + continueExec);
-					code.insert(code.end(), decFunc.begin(), decFunc.end());
+					std::vector<IrInstruction> stepFunc(count, {opcode == IrOpcode::VINC ? IrOpcode::INC : IrOpcode::DEC, {address}});
+					stepFunc.push_back({IrOpcode::JMP, {continueExec}});
+					expand(i, stepFunc);
 				}
 			}
 		}
 		void handleMovInstruction()
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::size_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<MOV>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<MOV, 2>(line);
+				auto opcode = instructions[i].opcode;
+				auto args = instructions[i].operands;
+				auto functionStart = static_cast<std::int64_t>(instructions.size());
+				auto continueExec = static_cast<std::int64_t>(i + 1);
 
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> movFunc =
-						{
-							/*00*/ "mov " + helpRegisters[0] + ", NULL",
-							/*01*/ "mov " + args[0] + ", NULL",
-							/*02*/ "tst " + args[1], /*start*/
-							/*03*/ "jmp " + std::to_string(functionStart + 5),
-							/*04*/ "jmp " + std::to_string(functionStart + 9),
-							/*05*/ "inc " + helpRegisters[0], /*bNotNull*/
-							/*06*/ "inc " + args[0],
-							/*07*/ "dec " + args[1],
-							/*08*/ "jmp " + std::to_string(functionStart + 2),
-							/*09*/ "tst " + helpRegisters[0], /*bNull*/
-							/*10*/ "jmp " + std::to_string(functionStart + 12),
-							/*11*/ "jmp " + continueExec,
-							/*12*/ "dec " + helpRegisters[0], /*restore*/
-							/*13*/ "inc " + args[1],
-							/*14*/ "jmp " + std::to_string(functionStart + 9)};
-					code.insert(code.end(), movFunc.begin(), movFunc.end());
-				}
-				else if (easyBonsaiRegex.matches<MOVN>(line))
+				if (opcode == IrOpcode::MOV)
 				{
-					auto args = easyBonsaiRegex.getArguments<MOVN, 1>(line);
-
-					auto functionStart = code.size();
-					auto continueExec = std::to_string(i + 1);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> movZeroFunc =
+					std::vector<IrInstruction> movFunc =
 						{
-							/*0*/ "tst " + args[0],
-							/*1*/ "jmp " + std::to_string(functionStart + 3),
-							/*2*/ "jmp " + continueExec,
-							/*3*/ "dec " + args[0],
-							/*4*/ "jmp " + std::to_string(functionStart + 0)};
-					code.insert(code.end(), movZeroFunc.begin(), movZeroFunc.end());
+							/*00*/ {IrOpcode::MOVN, {helpRegisters[0]}},
+							/*01*/ {IrOpcode::MOVN, {args[0]}},
+							/*02*/ {IrOpcode::TST, {args[1]}}, /*start*/
+							/*03*/ {IrOpcode::JMP, {functionStart + 5}},
+							/*04*/ {IrOpcode::JMP, {functionStart + 9}},
+							/*05*/ {IrOpcode::INC, {helpRegisters[0]}}, /*bNotNull*/
+							/*06*/ {IrOpcode::INC, {args[0]}},
+							/*07*/ {IrOpcode::DEC, {args[1]}},
+							/*08*/ {IrOpcode::JMP, {functionStart + 2}},
+							/*09*/ {IrOpcode::TST, {helpRegisters[0]}}, /*bNull*/
+							/*10*/ {IrOpcode::JMP, {functionStart + 12}},
+							/*11*/ {IrOpcode::JMP, {continueExec}},
+							/*12*/ {IrOpcode::DEC, {helpRegisters[0]}}, /*restore*/
+							/*13*/ {IrOpcode::INC, {args[1]}},
+							/*14*/ {IrOpcode::JMP, {functionStart + 9}}};
+					addMacroHint(MacroKind::MOV, i, functionStart, movFunc.size(), toText(args[0]), toText(args[1]));
+					expand(i, movFunc);
 				}
-			}
-		}
-		void handleOrInstruction()
-		{
-			for (int i = 0; code.size() > i; i++)
-			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<OR>(line))
+				else if (opcode == IrOpcode::MOVN)
 				{
-					auto args = easyBonsaiRegex.getArguments<OR, 2>(line);
-
-					auto functionStart = code.size();
-					auto trueBranch = std::to_string(i + 1);
-					auto falseBranch = std::to_string(i + 2);
-
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> orFunc =
+					std::vector<IrInstruction> movZeroFunc =
 						{
-							/*0*/ "tst " + args[0],
-							/*1*/ "jmp " + trueBranch,
-							/*2*/ "jmp " + std::to_string(functionStart + 3),
-							/*3*/ "tst " + args[1],
-							/*4*/ "jmp " + trueBranch,
-							/*5*/ "jmp " + falseBranch};
-					code.insert(code.end(), orFunc.begin(), orFunc.end());
+							/*0*/ {IrOpcode::TST, {args[0]}},
+							/*1*/ {IrOpcode::JMP, {functionStart + 3}},
+							/*2*/ {IrOpcode::JMP, {continueExec}},
+							/*3*/ {IrOpcode::DEC, {args[0]}},
+							/*4*/ {IrOpcode::JMP, {functionStart + 0}}};
+					addMacroHint(MacroKind::MOVN, i, functionStart, movZeroFunc.size(), toText(args[0]));
+					expand(i, movZeroFunc);
 				}
 			}
 		}
-		void handleAndInstruction()
+		/*
+			and and or continue at the next line if they are true and skip it otherwise.
+		*/
+		void handleLogicInstruction(IrOpcode logic)
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::size_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<AND>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<AND, 2>(line);
+				if (instructions[i].opcode != logic)
+					continue;
 
-					auto functionStart = code.size();
-					auto trueBranch = std::to_string(i + 1);
-					auto falseBranch = std::to_string(i + 2);
+				auto args = instructions[i].operands;
+				auto functionStart = static_cast<std::int64_t>(instructions.size());
+				IrInstruction trueBranch = {IrOpcode::JMP, {static_cast<std::int64_t>(i + 1)}};
+				IrInstruction falseBranch = {IrOpcode::JMP, {static_cast<std::int64_t>(i + 2)}};
+				IrInstruction second = {IrOpcode::JMP, {functionStart + 3}};
 
-					line = "jmp " + std::to_string(functionStart);
-					std::vector<std::string> orFunc =
-						{
-							/*0*/ "tst " + args[0],
-							/*1*/ "jmp " + std::to_string(functionStart + 3),
-							/*2*/ "jmp " + falseBranch,
-							/*3*/ "tst " + args[1],
-							/*4*/ "jmp " + trueBranch,
-							/*5*/ "jmp " + falseBranch};
-					code.insert(code.end(), orFunc.begin(), orFunc.end());
-				}
+				std::vector<IrInstruction> logicFunc =
+					{
+						/*0*/ {IrOpcode::TST, {args[0]}},
+						/*1*/ logic == IrOpcode::AND ? second : trueBranch,
+						/*2*/ logic == IrOpcode::AND ? falseBranch : second,
+						/*3*/ {IrOpcode::TST, {args[1]}},
+						/*4*/ trueBranch,
+						/*5*/ falseBranch};
+				expand(i, logicFunc);
 			}
 		}
 		void handleGotoInstruction()
 		{
-			for (auto &line : code)
+			for (auto &instruction : instructions)
 			{
-				if (easyBonsaiRegex.matches<GOTO>(line))
-				{
-					auto args = easyBonsaiRegex.getArguments<GOTO, 1>(line);
-					if (definedLabels | containsKey(args[0]))
-					{
-						line = "jmp " + std::to_string(definedLabels.at(args[0]));
-					}
-				}
-				else if (easyBonsaiRegex.matches<JMPTO>(line))
+				if (instruction.opcode != IrOpcode::GOTO && instruction.opcode != IrOpcode::JMPTO)
+					continue;
+
+				auto label = toText(instruction.operands[0]);
+				if (definedLabels | containsKey(label))
 				{
-					auto args = easyBonsaiRegex.getArguments<JMPTO, 1>(line);
-					if (definedLabels | containsKey(args[0]))
-					{
-						line = "jmp " + std::to_string(definedLabels.at(args[0]));
-					}
+					instruction = {IrOpcode::JMP, {resolve(references[definedLabels.at(label)]).first}, instruction.sourceLine};
 				}
 			}
 		}
 		void handleRJMPInstruction()
 		{
-			for (int i = 0; code.size() > i; i++)
+			for (std::int64_t i = 0; static_cast<std::int64_t>(instructions.size()) > i; i++)
 			{
-				auto &line = code[i];
-				if (easyBonsaiRegex.matches<JMPR>(line))
+				auto &instruction = instructions[i];
+				if (instruction.opcode == IrOpcode::JMPR)
 				{
-					auto args = easyBonsaiRegex.getArguments<JMPR, 1, std::int32_t>(line);
-					line = "jmp " + std::to_string(i + args[0]);
+					instruction = {IrOpcode::JMP, {i + std::get<std::int64_t>(instruction.operands[0])}, instruction.sourceLine};
 				}
 			}
 		}
@@ -1004,49 +1248,51 @@ namespace EasyBonsai
 			code = _code;
 
 			{
-				std::vector<std::uint32_t> toDelete;
-				for (int i = 0; code.size() > i; i++)
-				{
-					auto &line = code[i];
-					if (!line || (line | startsWith(";")))
-					{
-						toDelete.push_back(i);
-					}
-				}
-				for (int it = 0; toDelete.size() > it; it++)
-				{
-					auto index = toDelete[it] - it;
-					code | removeAt(index);
-				}
+				auto isComment = [](std::string &line) { return !line || (line | startsWith(";")); };
+				code.erase(std::remove_if(code.begin(), code.end(), isComment), code.end());
 			}
 
 			knownAddresses.insert(knownAddresses.end(), usedRegisters.begin(), usedRegisters.end());
 
+			instructions.clear();
+			lines.clear();
+			references.clear();
+			removals.clear();
+			for (std::uint32_t i = 0; code.size() > i; i++)
+			{
+				instructions.push_back(parseDeclaration(code[i], i));
+				instructions.back().sourceLine = i;
+				lines.push_back(i);
+			}
+
 			/*
 				Detect-Macros has to be run first, because the validation does not account for macros inside of the instruction.
 			*/
 
 			detectMacrosAndLabels();
+			layout();
 			detectUsedAddresses();
 
-			if (!isCodeValid())
+			if (!parseCode())
 				return {false, errorStack};
 
 			handleMathInstruction();
 			handleCmpInstruction();
 			handleMovInstruction();
-			handleAndInstruction();
-			handleOrInstruction();
+			handleLogicInstruction(IrOpcode::AND);
+			handleLogicInstruction(IrOpcode::OR);
 
 			handleGotoInstruction();
 			handleRJMPInstruction();
 
-			for (int i = 0; code.size() > i; i++)
+			code.clear();
+			code.reserve(instructions.size());
+			for (std::uint32_t i = 0; instructions.size() > i; i++)
 			{
-				auto &line = code[i];
-				if (!bonsaiRegex.matchesAny(line))
+				code.push_back(toText(instructions[i]));
+				if (!isBonsai(instructions[i]))
 				{
-					errorStack.push_back(printfs("Unexpected instruction \"%s\" in line %u", line.c_str(), i));
+					errorStack.push_back(printfs("Unexpected instruction \"%s\" in line %u", code.back().c_str(), i));
 				}
 			}
 			if (errorStack.size() > 0)
@@ -1054,6 +1300,17 @@ namespace EasyBonsai
 
 			return {true, code};
 		}
+		Hints getHints()
+		{
+			Hints rtn;
+			rtn.programHash = hashProgram(code);
+			rtn.macros = macroHints;
+			rtn.helpRegisters[0] = std::stoul(helpRegisters[0]);
+			rtn.helpRegisters[1] = std::stoul(helpRegisters[1]);
+			rtn.cmpRegisters[0] = std::stoul(cmpRegisters[0]);
+			rtn.cmpRegisters[1] = std::stoul(cmpRegisters[1]);
+			return rtn;
+		}
 		std::vector<std::uint32_t> getNeededRegisters()
 		{
 			return {(std::uint32_t)std::stoi(cmpRegisters[0]), (std::uint32_t)std::stoi(cmpRegisters[1]), (std::uint32_t)std::stoi(helpRegisters[0]), (std::uint32_t)std::stoi(helpRegisters[1]), (std::uint32_t)std::stoi(returnRegister)};
@@ -0,0 +1,204 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sstream>
+#include <optional>
+#include <algorithm>
+
+namespace EasyBonsai
+{
+	enum class DebugAction
+	{
+		None,
+		Log,
+		Break
+	};
+
+	/*
+		Fires on every write to address, or only on writes of value if one is given.
+	*/
+	struct Watchpoint
+	{
+		std::uint32_t address = 0;
+		std::optional<std::uint64_t> value;
+		DebugAction action = DebugAction::Log;
+	};
+	struct Condition
+	{
+		std::uint32_t address = 0;
+		bool equal = true;
+		std::uint64_t value = 0;
+	};
+	/*
+		Fires before line is executed, if a condition is given only while it holds.
+	*/
+	struct Breakpoint
+	{
+		std::uint32_t line = 0;
+		std::optional<Condition> condition;
+	};
+
+	/*
+		"R" logs every change of register R, "R=V" only changes to V, ":break" breaks instead of logging.
+	*/
+	inline std::optional<Watchpoint> parseWatchpoint(const std::string &text)
+	{
+		Watchpoint rtn;
+		std::istringstream stream(text);
+		if (!(stream >> rtn.address))
+			return std::nullopt;
+
+		char next;
+		if (!(stream >> next))
+			return rtn;
+		if (next == '=')
+		{
+			std::uint64_t value;
+			if (!(stream >> value))
+				return std::nullopt;
+
+			rtn.value = value;
+			if (!(stream >> next))
+				return rtn;
+		}
+
+		std::string action;
+		if (next != ':' || !(stream >> action) || action != "break")
+			return std::nullopt;
+
+		rtn.action = DebugAction::Break;
+		return rtn;
+	}
+	/*
+		"L" breaks before line L, "L:R=V" and "L:R!=V" only if register R holds (or does not hold) V.
+	*/
+	inline std::optional<Breakpoint> parseBreakpoint(const std::string &text)
+	{
+		Breakpoint rtn;
+		std::istringstream stream(text);
+		if (!(stream >> rtn.line))
+			return std::nullopt;
+
+		char next;
+		if (!(stream >> next))
+			return rtn;
+
+		Condition condition;
+		if (next != ':' || !(stream >> condition.address >> next))
+			return std::nullopt;
+		if (next == '!')
+		{
+			condition.equal = false;
+			stream >> next;
+		}
+		if (next != '=' || !(stream >> condition.value) || stream >> next)
+			return std::nullopt;
+
+		rtn.condition = condition;
+		return rtn;
+	}
+
+	/*
+		Holds the watchpoints and breakpoints of a run, the executor asks it on every write to a watched slot and every line with a breakpoint.
+		Both are looked up through a table per slot and per line, so lines and registers without any cost nothing but the lookup.
+	*/
+	class Debugger
+	{
+	private:
+		static constexpr std::uint32_t noSlot = 0xFFFFFFFF;
+
+		std::vector<Watchpoint> watchpoints;
+		std::vector<Breakpoint> breakpoints;
+
+		std::vector<std::uint32_t> watchSlots;
+		std::vector<std::uint32_t> conditionSlots;
+		std::vector<std::uint8_t> watchedSlots;
+		std::vector<std::uint8_t> breakLines;
+
+	public:
+		void addWatchpoint(const Watchpoint &watchpoint)
+		{
+			watchpoints.push_back(watchpoint);
+		}
+		void addBreakpoint(const Breakpoint &breakpoint)
+		{
+			breakpoints.push_back(breakpoint);
+		}
+		const std::vector<Watchpoint> &getWatchpoints() const
+		{
+			return watchpoints;
+		}
+		const std::vector<Breakpoint> &getBreakpoints() const
+		{
+			return breakpoints;
+		}
+		/*
+			Translates addresses into the slots of the loaded program, registers the program does not use can never change.
+		*/
+		void prepare(const std::vector<std::uint32_t> &addresses, std::size_t lineCount)
+		{
+			auto slotOf = [&](std::uint32_t address) {
+				auto slot = std::find(addresses.begin(), addresses.end(), address);
+				return slot == addresses.end() ? noSlot : static_cast<std::uint32_t>(slot - addresses.begin());
+			};
+
+			watchSlots.clear();
+			conditionSlots.clear();
+			watchedSlots.assign(addresses.size(), 0);
+			breakLines.assign(lineCount, 0);
+
+			for (const auto &watchpoint : watchpoints)
+			{
+				watchSlots.push_back(slotOf(watchpoint.address));
+				if (watchSlots.back() != noSlot)
+					watchedSlots[watchSlots.back()] = 1;
+			}
+			for (const auto &breakpoint : breakpoints)
+			{
+				conditionSlots.push_back(breakpoint.condition ? slotOf(breakpoint.condition->address) : noSlot);
+				if (lineCount > breakpoint.line)
+					breakLines[breakpoint.line] = 1;
+			}
+		}
+		inline bool isWatched(std::uint32_t slot) const
+		{
+			return watchedSlots[slot];
+		}
+		inline bool hasBreakpoint(std::uint32_t line) const
+		{
+			return breakLines[line];
+		}
+		/*
+			Break wins over log if several watchpoints fire.
+		*/
+		DebugAction onWrite(std::uint32_t slot, std::uint64_t value) const
+		{
+			auto rtn = DebugAction::None;
+			for (std::size_t i = 0; watchpoints.size() > i; i++)
+			{
+				if (watchSlots[i] != slot || (watchpoints[i].value && *watchpoints[i].value != value))
+					continue;
+
+				rtn = std::max(rtn, watchpoints[i].action);
+			}
+			return rtn;
+		}
+		template <typename Register> bool breaksAt(std::uint32_t line, const Register *registers) const
+		{
+			for (std::size_t i = 0; breakpoints.size() > i; i++)
+			{
+				const auto &breakpoint = breakpoints[i];
+				if (breakpoint.line != line)
+					continue;
+				if (!breakpoint.condition)
+					return true;
+
+				std::uint64_t value = conditionSlots[i] == noSlot ? 0 : registers[conditionSlots[i]];
+				if ((value == breakpoint.condition->value) == breakpoint.condition->equal)
+					return true;
+			}
+			return false;
+		}
+	};
+} // namespace EasyBonsai
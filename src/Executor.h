@@ -1,83 +1,166 @@
 #pragma once
 #include <map>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <variant>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include "Jit.h"
+#include "Hints.h"
+#include "Binary.h"
+#include "Trace.h"
+#include "Profile.h"
+#include "Debugger.h"
+#include "Checkpoint.h"
+#include "Operation.h"
 #include "Console.h"
 #include "Compiler.h"
 #include "belegpp/belegpp.h"
 
 namespace EasyBonsai
 {
-	class Executor
+	enum class ExecutionMode
 	{
+		Reference,
+		Decoded,
+		Threaded,
+		Jit
+	};
+
+	/*
+		Where a budgeted run stopped, ip is the line execution continues at (or that halted or failed).
+	*/
+	struct RunResult
+	{
+		RunStatus status;
+		std::uint32_t ip;
+		std::uint64_t steps;
+	};
+
+	/*
+		Register is the type of every register, all arithmetic wraps around at its width.
+		Addresses, slots and lines stay 32 bit no matter the register width.
+	*/
+	template <typename Register = std::uint32_t> class BasicExecutor
+	{
+		static_assert(std::is_unsigned_v<Register> && !std::is_same_v<Register, bool>, "Registers are unsigned integers");
+
 	private:
+		static constexpr std::uint32_t budgetExhausted = std::numeric_limits<std::uint32_t>::max();
+
+		std::uint64_t steps = 0;
+		std::uint32_t position = 0;
+		RunStatus status = RunStatus::Exhausted;
+		ExecutionMode mode = ExecutionMode::Threaded;
+
+		bool profiling = false;
+		bool detectingCycles = false;
+		Profile profile;
+
+		/*
+			Where cycle detection stopped at the end of a runFor slice, the next slice continues the search.
+		*/
+		struct CycleSearch
+		{
+			bool searching = false;
+			std::uint64_t stateHash = 0, savedHash = 0, power = 1, sinceSave = 0;
+			std::uint32_t savedIp = 0;
+			std::vector<Register> savedRegisters;
+		} cycleSearch;
+		TraceBuffer *trace = nullptr;
+		Debugger *debugger = nullptr;
+
+		/*
+			Programs loaded from the binary format have no code, lineCount and programHash describe both kinds.
+		*/
 		std::vector<std::string> code;
+		std::uint32_t lineCount = 0;
+		std::uint64_t programHash = 0;
+		std::vector<Operation> operations;
+		std::vector<Operation> threaded;
 		std::vector<std::string> errorStack;
-		std::map<std::uint32_t, std::uint32_t> registers;
-	public:
-		Executor() { }
-		auto getErrorstack()
-		{
-			return errorStack;
-		}
-		auto getRegisters()
-		{
-			return registers;
-		}
-		void setRegister(std::uint32_t id, std::uint32_t value)
+
+		std::vector<std::pair<std::uint32_t, Operation>> macros;
+		std::uint32_t helpSlots[2] = {0, 0};
+		std::uint32_t cmpSlots[2] = {0, 0};
+		std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> registerEffects;
+
+		/*
+			Bonsai addresses may be arbitrarily high and scattered, so every used address gets a dense slot.
+			Decoded operations refer to slots, addresses are only translated back for the outside.
+		*/
+		std::vector<Register> registers;
+		std::vector<std::uint32_t> addresses;
+		std::map<std::uint32_t, std::uint32_t> slots;
+
+	private:
+		std::uint32_t getSlot(std::uint32_t address)
 		{
-			registers[id] = value;
+			auto slot = slots.find(address);
+			if (slot != slots.end())
+				return slot->second;
+
+			auto newSlot = static_cast<std::uint32_t>(registers.size());
+			slots.insert({address, newSlot});
+			addresses.push_back(address);
+			registers.push_back(0);
+
+			return newSlot;
 		}
-		bool load(std::vector<std::string> _code)
+		Operation decode(const std::string &line, std::uint32_t index)
 		{
-			code = _code;
-			for (int i = 0; code.size() > i; i++)
+			if (bonsaiInstructions.matches<TST>(line))
+				return {Opcode::TST, {1, 1}, getSlot(bonsaiInstructions.getArguments<TST, 1, std::uint32_t>(line)[0])};
+			if (bonsaiInstructions.matches<INC>(line))
+				return {Opcode::INC, {1, 1}, getSlot(bonsaiInstructions.getArguments<INC, 1, std::uint32_t>(line)[0])};
+			if (bonsaiInstructions.matches<DEC>(line))
+				return {Opcode::DEC, {1, 1}, getSlot(bonsaiInstructions.getArguments<DEC, 1, std::uint32_t>(line)[0])};
+			if (bonsaiInstructions.matches<JMP>(line))
 			{
-				const auto& line = code[i];
-				if (!EasyBonsai::bonsaiRegex.matchesAny(line))
-				{
-					errorStack.push_back(printfs("Unkown instruction \"%s\" in line %u", line.c_str(), i));
-				}
-				else
-				{
-					auto args = EasyBonsai::bonsaiRegex.getUsedAddys<std::uint32_t>(line);
-					for (auto arg : args)
-					{
-						registers[arg] = 0;
-					}
-				}
+				/*
+					Out of bounds jumps are only an error once they are taken, so they are decoded into a trap that remembers the line it came from.
+				*/
+				std::uint64_t destination;
+				if (!internal::parseNumber(bonsaiInstructions.getArguments<JMP, 1>(line)[0], destination) || destination >= lineCount)
+					return {Opcode::TRAP, {1, 1}, index};
+
+				return {Opcode::JMP, {1, 1}, static_cast<std::uint32_t>(destination)};
 			}
+			if (bonsaiInstructions.matches<INT>(line))
+				return {Opcode::INT, {1, 1}, 0};
 
-			return errorStack.size() <= 0;
+			return {Opcode::HLT, {1, 1}, 0};
 		}
-		bool run()
+		bool runReference()
 		{
 			using namespace EasyBonsai;
 
 			std::uint32_t ip = 0;
 			while (true)
 			{
-				const auto& line = code[ip++];
+				const auto &line = code[ip++];
+				steps++;
 
 #ifndef BONSAI_WEB
-				if (bonsaiRegex.matches<INT>(line))
+				if (bonsaiInstructions.matches<INT>(line))
 				{
-					Console::debug << "Interrupt called! Registers: " << (registers | join(",")) << Console::endl;
+					Console::debug << "Interrupt called! Registers: " << (getPrintableRegisters(registers.data()) | join(",")) << Console::endl;
 					std::cin.get();
 				}
 #endif
-				if (bonsaiRegex.matches<TST>(line))
+				if (bonsaiInstructions.matches<TST>(line))
 				{
-					auto args = bonsaiRegex.getArguments<TST, 1, std::uint32_t>(line);
-					if (registers.at(args[0]) <= 0)
+					auto args = bonsaiInstructions.getArguments<TST, 1, std::uint32_t>(line);
+					if (registers[slots.at(args[0])] <= 0)
 					{
 						ip++;
 					}
 				}
-				if (bonsaiRegex.matches<JMP>(line))
+				if (bonsaiInstructions.matches<JMP>(line))
 				{
-					auto args = bonsaiRegex.getArguments<JMP, 1, std::uint32_t>(line);
+					auto args = bonsaiInstructions.getArguments<JMP, 1, std::uint32_t>(line);
 					auto newIP = args[0];
 					if (newIP >= code.size() || newIP < 0)
 					{
@@ -86,23 +169,1129 @@ namespace EasyBonsai
 					}
 					ip = args[0];
 				}
-				if (bonsaiRegex.matches<INC>(line))
+				if (bonsaiInstructions.matches<INC>(line))
+				{
+					auto args = bonsaiInstructions.getArguments<INC, 1, std::uint32_t>(line);
+					registers[slots.at(args[0])]++;
+				}
+				if (bonsaiInstructions.matches<DEC>(line))
+				{
+					auto args = bonsaiInstructions.getArguments<DEC, 1, std::uint32_t>(line);
+					registers[slots.at(args[0])]--;
+				}
+				if (bonsaiInstructions.matches<HLT>(line) || ip >= code.size())
+				{
+					break;
+				}
+			}
+
+			return true;
+		}
+		/*
+			The share of one register in the state hash, the state hash is the sum of the shares of all registers.
+		*/
+		static std::uint64_t hashRegister(std::uint32_t slot, std::uint64_t value)
+		{
+			auto rtn = value + (static_cast<std::uint64_t>(slot) + 1) * 0x9e3779b97f4a7c15ull;
+			rtn = (rtn ^ (rtn >> 30)) * 0xbf58476d1ce4e5b9ull;
+			rtn = (rtn ^ (rtn >> 27)) * 0x94d049bb133111ebull;
+			return rtn ^ (rtn >> 31);
+		}
+		/*
+			Shows why the debugger stopped and waits for enter, like int does.
+		*/
+		void pause([[maybe_unused]] const std::string &reason)
+		{
+#ifndef BONSAI_WEB
+			Console::debug << reason << " Registers: " << (getPrintableRegisters(registers.data()) | join(",")) << Console::endl;
+			std::cin.get();
+#endif
+		}
+		void watch(std::uint32_t ip, std::uint32_t slot, std::uint64_t step)
+		{
+			auto action = debugger->onWrite(slot, registers[slot]);
+			if (action == DebugAction::Log)
+			{
+#ifndef BONSAI_WEB
+				Console::debug << printfs("Line %u: [$%u] = %llu", ip, addresses[slot], static_cast<unsigned long long>(registers[slot])) << Console::endl;
+#endif
+			}
+			else if (action == DebugAction::Break)
+				pause(printfs("Watchpoint [$%u] = %llu hit in line %u after %llu steps!", addresses[slot], static_cast<unsigned long long>(registers[slot]), ip, static_cast<unsigned long long>(step)));
+		}
+		/*
+			Profiling, tracing, cycle detection and debugging are template parameters, so the counting, recording and checks do not exist in the normal decoded loop.
+
+			Cycle detection follows Brent: the state (ip and registers) is saved whenever the number of steps since the last save reaches the next power of two and every later state is compared against it.
+			A program that repeats a state never halts, the repetition is found at the latest after about twice the steps it takes to enter the cycle plus the cycle length.
+			The registers are hashed incrementally, so a step costs one hash update on inc/dec and one comparison, the registers are only compared when the hashes match.
+			Saving copies the registers, which happens once per power of two steps.
+
+			Budgeted runs start at position and stop once budget steps were taken, position is then the line to continue at.
+			The search for a cycle is carried over into the next slice, so slicing a run never changes when (or whether) a cycle is found.
+		*/
+		template <bool Profiling = false, bool Tracing = false, bool DetectCycles = false, bool Debugging = false, bool Budgeted = false> RunStatus runDecoded([[maybe_unused]] std::uint64_t budget = 0)
+		{
+			std::uint32_t ip = Budgeted ? position : 0;
+			std::uint64_t executed = 0;
+			const auto *program = operations.data();
+			auto *registerFile = registers.data();
+
+			[[maybe_unused]] std::uint64_t stateHash = 0, savedHash = 0, power = 1, sinceSave = 0;
+			[[maybe_unused]] std::uint32_t savedIp = ip;
+			[[maybe_unused]] std::vector<Register> savedRegisters;
+			if constexpr (DetectCycles)
+			{
+				if (Budgeted && cycleSearch.searching)
+				{
+					stateHash = cycleSearch.stateHash;
+					savedHash = cycleSearch.savedHash;
+					power = cycleSearch.power;
+					sinceSave = cycleSearch.sinceSave;
+					savedIp = cycleSearch.savedIp;
+					savedRegisters = std::move(cycleSearch.savedRegisters);
+				}
+				else
+				{
+					for (std::uint32_t slot = 0; registers.size() > slot; slot++)
+					{
+						stateHash += hashRegister(slot, registerFile[slot]);
+					}
+					savedHash = stateHash;
+					savedRegisters = registers;
+				}
+				cycleSearch.searching = false;
+			}
+
+			while (true)
+			{
+				if constexpr (Budgeted)
+				{
+					if (executed >= budget)
+					{
+						if constexpr (DetectCycles)
+							cycleSearch = {true, stateHash, savedHash, power, sinceSave, savedIp, std::move(savedRegisters)};
+						steps += executed;
+						position = ip;
+						return RunStatus::Exhausted;
+					}
+				}
+				if constexpr (DetectCycles)
+				{
+					if (sinceSave && stateHash == savedHash && ip == savedIp && savedRegisters == registers)
+					{
+						steps += executed;
+						position = ip;
+						errorStack.push_back(printfs("Program entered a state it has been in before at line %u, step %llu (cycle of %llu steps)", ip, static_cast<unsigned long long>(steps), static_cast<unsigned long long>(sinceSave)));
+						return RunStatus::Error;
+					}
+					if (sinceSave == power)
+					{
+						savedHash = stateHash;
+						savedIp = ip;
+						savedRegisters = registers;
+						power *= 2;
+						sinceSave = 0;
+					}
+					sinceSave++;
+				}
+				if constexpr (Profiling)
+					profile.executions[ip]++;
+				if constexpr (Debugging)
+				{
+					if (debugger->hasBreakpoint(ip) && debugger->breaksAt(ip, registerFile))
+						pause(printfs("Breakpoint in line %u after %llu steps!", ip, static_cast<unsigned long long>(steps + executed)));
+				}
+
+				const auto &operation = program[ip++];
+				switch (operation.opcode)
+				{
+				case Opcode::TST:
+					if (registerFile[operation.operand] <= 0)
+					{
+						if constexpr (Profiling)
+							profile.taken[ip - 1]++;
+						ip++;
+					}
+					break;
+				case Opcode::JMP:
+					ip = operation.operand;
+					break;
+				case Opcode::INC:
+					if constexpr (DetectCycles)
+						stateHash += hashRegister(operation.operand, static_cast<Register>(registerFile[operation.operand] + 1)) - hashRegister(operation.operand, registerFile[operation.operand]);
+					registerFile[operation.operand]++;
+					if constexpr (Tracing)
+						trace->record(ip - 1, operation.operand, static_cast<std::uint32_t>(registerFile[operation.operand]));
+					if constexpr (Debugging)
+					{
+						if (debugger->isWatched(operation.operand))
+							watch(ip - 1, operation.operand, steps + executed + 1);
+					}
+					break;
+				case Opcode::DEC:
+					if constexpr (DetectCycles)
+						stateHash += hashRegister(operation.operand, static_cast<Register>(registerFile[operation.operand] - 1)) - hashRegister(operation.operand, registerFile[operation.operand]);
+					registerFile[operation.operand]--;
+					if constexpr (Tracing)
+						trace->record(ip - 1, operation.operand, static_cast<std::uint32_t>(registerFile[operation.operand]));
+					if constexpr (Debugging)
+					{
+						if (debugger->isWatched(operation.operand))
+							watch(ip - 1, operation.operand, steps + executed + 1);
+					}
+					break;
+				case Opcode::INT:
+#ifndef BONSAI_WEB
+					Console::debug << "Interrupt called! Registers: " << (getPrintableRegisters(registers.data()) | join(",")) << Console::endl;
+					std::cin.get();
+#endif
+					break;
+				case Opcode::TRAP:
+					steps += executed + 1;
+					position = ip - 1;
+					errorStack.push_back(printfs("Jmp Destination out of bounds in line %u", operation.operand + 1));
+					return RunStatus::Error;
+				case Opcode::HLT:
+					steps += executed + 1;
+					position = ip - 1;
+					return RunStatus::Halted;
+				case Opcode::END:
+				case Opcode::BRANCH:
+				case Opcode::ADD:
+				case Opcode::SUB:
+				case Opcode::MOV:
+				case Opcode::MOVN:
+				case Opcode::CMP:
+				case Opcode::LOOP:
+				case Opcode::BLOCK:
+					steps += executed;
+					position = ip - 1;
+					return RunStatus::Halted;
+				}
+				executed++;
+			}
+		}
+		std::pair<std::uint32_t, std::uint8_t> followJumps(const std::vector<Operation> &linked, std::uint32_t target)
+		{
+			/*
+				Jumps are deterministic, so a chain can be skipped as long as its length is accounted for.
+				The length limit also keeps jmp-cycles from folding forever.
+			*/
+			std::uint8_t hops = 0;
+			while (linked[target].opcode == Opcode::JMP && hops < 64)
+			{
+				target = linked[target].operand;
+				hops++;
+			}
+			return {target, hops};
+		}
+		void fuse()
+		{
+			auto linked = operations;
+			registerEffects.clear();
+			for (const auto &macro : macros)
+			{
+				linked[macro.first] = macro.second;
+			}
+
+			threaded = linked;
+			for (std::size_t i = 0; linked.size() > i; i++)
+			{
+				const auto &operation = linked[i];
+				if (operation.opcode == Opcode::JMP)
+				{
+					auto [target, hops] = followJumps(linked, operation.operand);
+					threaded[i].operand = target;
+					threaded[i].costs[0] = 1 + hops;
+				}
+				else if (operation.opcode == Opcode::TST && linked[i + 1].opcode == Opcode::JMP && linked[i + 2].opcode == Opcode::JMP)
+				{
+					/*
+						tst x; jmp a; jmp b - is the branch the compiler emits for nearly everything, it's run as one operation.
+					*/
+					auto [notZero, notZeroHops] = followJumps(linked, linked[i + 1].operand);
+					auto [zero, zeroHops] = followJumps(linked, linked[i + 2].operand);
+
+					threaded[i] = {Opcode::BRANCH, {static_cast<std::uint8_t>(2 + notZeroHops), static_cast<std::uint8_t>(2 + zeroHops)}, operation.operand, {notZero, zero}};
+					summarizeLoop(linked, i);
+				}
+			}
+
+			collapseBlocks(linked);
+		}
+		void collapseBlocks(const std::vector<Operation> &linked)
+		{
+			/*
+				Every basic block leader that starts a straight run of inc/dec gets the summed up change of the rest of the run.
+				The single operations stay in place, so any other entry into the run still works.
+			*/
+			std::vector<bool> isLeader(linked.size(), false);
+			isLeader[0] = true;
+			for (std::size_t i = 0; linked.size() > i; i++)
+			{
+				const auto &operation = linked[i];
+				const auto &fused = threaded[i];
+				switch (operation.opcode)
+				{
+				case Opcode::TST:
+					isLeader[i + 1] = isLeader[i + 2] = true;
+					break;
+				case Opcode::JMP:
+					isLeader[operation.operand] = isLeader[i + 1] = true;
+					break;
+				case Opcode::ADD:
+				case Opcode::SUB:
+				case Opcode::MOV:
+				case Opcode::MOVN:
+				case Opcode::CMP:
+					isLeader[operation.targets[1]] = true;
+					break;
+				default:
+					break;
+				}
+				if (fused.opcode == Opcode::JMP)
+					isLeader[fused.operand] = true;
+				if (fused.opcode == Opcode::BRANCH)
+					isLeader[fused.targets[0]] = isLeader[fused.targets[1]] = true;
+				if (fused.opcode == Opcode::LOOP)
+					isLeader[fused.targets[1]] = true;
+			}
+
+			auto isStraight = [&](std::size_t index) { return linked[index].opcode == Opcode::INC || linked[index].opcode == Opcode::DEC; };
+			for (std::size_t start = 0; linked.size() > start; start++)
+			{
+				if (!isStraight(start))
+					continue;
+
+				auto end = start;
+				while (isStraight(end))
+					end++;
+
+				std::map<std::uint32_t, std::uint32_t> deltas;
+				for (auto i = end; i-- > start;)
+				{
+					deltas[linked[i].operand] += (linked[i].opcode == Opcode::INC) ? 1 : static_cast<std::uint32_t>(-1);
+
+					auto length = end - i;
+					if ((i == start || isLeader[i]) && length >= 3)
+					{
+						std::vector<std::pair<std::uint32_t, std::uint32_t>> effects;
+						for (const auto &delta : deltas)
+						{
+							if (delta.second != 0)
+								effects.push_back(delta);
+						}
+
+						threaded[i] = {Opcode::BLOCK, {0, 0}, static_cast<std::uint32_t>(registerEffects.size()), {static_cast<std::uint32_t>(end), static_cast<std::uint32_t>(length)}};
+						registerEffects.push_back(effects);
+					}
+				}
+
+				start = end;
+			}
+		}
+		void summarizeLoop(const std::vector<Operation> &linked, std::size_t header)
+		{
+			/*
+				Detects counted loops:
+					tst c
+					jmp body
+					jmp exit
+				body:
+					inc/dec ... (c decreases by exactly one)
+					jmp header
+				Such a loop runs c times and can be replaced by adding c-times the change of every register.
+			*/
+			std::map<std::uint32_t, std::uint32_t> deltas;
+			auto counter = linked[header].operand;
+
+			auto end = linked[header + 1].operand;
+			while ((linked[end].opcode == Opcode::INC || linked[end].opcode == Opcode::DEC) && (end - linked[header + 1].operand) < 250)
+			{
+				deltas[linked[end].operand] += (linked[end].opcode == Opcode::INC) ? 1 : static_cast<std::uint32_t>(-1);
+				end++;
+			}
+
+			if (linked[end].opcode != Opcode::JMP || linked[end].operand != header || deltas[counter] != static_cast<std::uint32_t>(-1))
+				return;
+
+			std::vector<std::pair<std::uint32_t, std::uint32_t>> effects;
+			for (const auto &delta : deltas)
+			{
+				if (delta.first != counter && delta.second != 0)
+					effects.push_back(delta);
+			}
+
+			auto &branch = threaded[header];
+			auto bodyLength = end - linked[header + 1].operand;
+
+			branch.opcode = Opcode::LOOP;
+			branch.costs[0] = static_cast<std::uint8_t>(bodyLength + 3);
+			branch.targets[0] = static_cast<std::uint32_t>(registerEffects.size());
+			registerEffects.push_back(effects);
+		}
+		/*
+			The amount of steps the compiler template of a macro operation would take on the given registers.
+		*/
+		std::uint64_t getMacroCost(const Operation &operation, const Register *registerFile) const
+		{
+			auto target = registerFile[operation.operand];
+			auto help = registerFile[helpSlots[0]];
+
+			switch (operation.opcode)
+			{
+			case Opcode::MOVN:
+				return 3 + 4ull * target;
+			case Opcode::MOV:
+				return 11 + 4ull * help + 4ull * target + 11ull * registerFile[operation.targets[0]];
+			case Opcode::ADD:
+			case Opcode::SUB:
+				return 14 + 4ull * help + 4ull * registerFile[helpSlots[1]] + 16ull * registerFile[operation.targets[0]];
+			case Opcode::CMP:
+			{
+				std::uint64_t x = target, y = registerFile[operation.targets[0]];
+				auto common = std::min(x, y);
+
+				std::uint64_t cost = 1 + (11 + 4 * help + 4ull * registerFile[cmpSlots[0]] + 11 * x) + (11 + 4ull * registerFile[cmpSlots[1]] + 11 * y) + 7 * common + 4;
+				cost += (11 + 4 * (x - common) + 11 * x) + (11 + 4 * (y - common) + 11 * y) + (3 + 4 * x) + (3 + 4 * y) + (x >= y ? 1 : 0) + 1;
+				return cost;
+			}
+			default:
+				return 0;
+			}
+		}
+		std::uint64_t runMacro(const Operation &operation, Register *registerFile) const
+		{
+			/*
+				Leaves the registers exactly like the compiler template would and returns the amount of steps the template would have taken.
+			*/
+			auto cost = getMacroCost(operation, registerFile);
+			auto &target = registerFile[operation.operand];
+			auto &help = registerFile[helpSlots[0]];
+
+			switch (operation.opcode)
+			{
+			case Opcode::MOVN:
+				target = 0;
+				break;
+			case Opcode::MOV:
+				target = registerFile[operation.targets[0]];
+				help = 0;
+				break;
+			case Opcode::ADD:
+			case Opcode::SUB:
+			{
+				auto value = registerFile[operation.targets[0]];
+				if (operation.opcode == Opcode::ADD)
+					target += value;
+				else
+					target -= value;
+				help = 0;
+				registerFile[helpSlots[1]] = 0;
+				break;
+			}
+			case Opcode::CMP:
+			{
+				std::uint64_t x = target, y = registerFile[operation.targets[0]];
+				registerFile[cmpSlots[0]] = x > y;
+				registerFile[cmpSlots[1]] = x == y;
+				help = 0;
+				break;
+			}
+			default:
+				break;
+			}
+			return cost;
+		}
+		/*
+			Runs the single, unfused operation of a line and returns the line to continue at, budgeted runs use it for fused operations that do not fit into the rest of their budget.
+			Fused operations only ever sit on a tst, inc, dec or jmp.
+		*/
+		std::uint32_t stepUnfused(std::uint32_t line, Register *registerFile) const
+		{
+			const auto &operation = operations[line];
+			switch (operation.opcode)
+			{
+			case Opcode::TST:
+				return registerFile[operation.operand] <= 0 ? line + 2 : line + 1;
+			case Opcode::INC:
+				registerFile[operation.operand]++;
+				return line + 1;
+			case Opcode::DEC:
+				registerFile[operation.operand]--;
+				return line + 1;
+			default:
+				return operation.operand;
+			}
+		}
+		/*
+			Only reads the executor, so one decoded program can be run on many register files at once.
+			Every fused operation stands for running the code from its line on, so execution may start at any line.
+			Returns 0 on hlt or at the end of the code and line+1 of a taken out of bounds jump.
+			Budgeted runs stop after exactly budget steps, return budgetExhausted and store the line to continue at.
+			Fused operations that would take more steps than are left run their lines one at a time instead, counted loops first run as many rounds as fit.
+		*/
+		template <bool Budgeted = false> std::uint32_t runThreaded(Register *registerFile, std::uint64_t &stepCount, std::uint32_t start = 0, std::uint64_t budget = 0, std::uint32_t *stoppedAt = nullptr) const
+		{
+			const auto *program = threaded.data();
+			const auto *operation = program + start;
+			std::uint64_t executed = 0;
+
+			/*
+				GNU compilers get a computed goto per operation, which gives every operation its own indirect branch.
+				Everything else falls back to a switch.
+				Budgeted runs step the single operation of the line instead of a fused one that takes more steps than are left.
+			*/
+#define BONSAI_UNFUSED_UNLESS_FITS(cost) if constexpr (Budgeted) { if ((cost) > budget - executed) { executed++; operation = program + stepUnfused(static_cast<std::uint32_t>(operation - program), registerFile); BONSAI_DISPATCH(); } }
+#if defined(__GNUC__) && !defined(__EMSCRIPTEN__)
+			static const void *dispatchTable[] = {&&tst, &&jmp, &&inc, &&dec, &&hlt, &&interrupt, &&trap, &&end, &&branch, &&add, &&sub, &&mov, &&movn, &&cmp, &&loop, &&block};
+#define BONSAI_OPERATION(label, opcode) label:
+#define BONSAI_DISPATCH() { if constexpr (Budgeted) { if (executed >= budget) goto exhausted; } goto *dispatchTable[static_cast<std::size_t>(operation->opcode)]; }
+			BONSAI_DISPATCH();
+#else
+#define BONSAI_OPERATION(label, opcode) case opcode:
+#define BONSAI_DISPATCH() continue
+			while (true)
+			{
+				if constexpr (Budgeted)
+				{
+					if (executed >= budget)
+						goto exhausted;
+				}
+				switch (operation->opcode)
+				{
+#endif
+			BONSAI_OPERATION(tst, Opcode::TST)
+			{
+				executed++;
+				if (registerFile[operation->operand] <= 0)
+				{
+					operation += 2;
+					BONSAI_DISPATCH();
+				}
+				operation++;
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(branch, Opcode::BRANCH)
+			{
+				/*
+					Both outcomes get their own dispatch, a select here would make the next fetch wait on the register load.
+				*/
+				if (registerFile[operation->operand] <= 0)
+				{
+					BONSAI_UNFUSED_UNLESS_FITS(operation->costs[1]);
+					executed += operation->costs[1];
+					operation = program + operation->targets[1];
+					BONSAI_DISPATCH();
+				}
+				BONSAI_UNFUSED_UNLESS_FITS(operation->costs[0]);
+				executed += operation->costs[0];
+				operation = program + operation->targets[0];
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(loop, Opcode::LOOP)
+			{
+				auto count = registerFile[operation->operand];
+				if constexpr (Budgeted)
+				{
+					auto left = budget - executed;
+					if (operation->costs[1] > left || static_cast<std::uint64_t>(count) > (left - operation->costs[1]) / operation->costs[0])
+					{
+						/*
+							Only the rounds that fit into the budget are run, the counter keeps the rest and the next dispatch continues with the loop.
+							Without a whole round left the lines run one at a time.
+						*/
+						auto rounds = static_cast<Register>(std::min<std::uint64_t>(count, left / operation->costs[0]));
+						if (rounds == 0)
+						{
+							executed++;
+							operation = program + stepUnfused(static_cast<std::uint32_t>(operation - program), registerFile);
+							BONSAI_DISPATCH();
+						}
+						for (const auto &effect : registerEffects[operation->targets[0]])
+						{
+							registerFile[effect.first] += multiply(rounds, toRegister(effect.second));
+						}
+						registerFile[operation->operand] -= rounds;
+						executed += static_cast<std::uint64_t>(rounds) * operation->costs[0];
+						BONSAI_DISPATCH();
+					}
+				}
+				if (count > 0)
 				{
-					auto args = bonsaiRegex.getArguments<INC, 1, std::uint32_t>(line);
-					registers.at(args[0])++;
+					for (const auto &effect : registerEffects[operation->targets[0]])
+					{
+						registerFile[effect.first] += multiply(count, toRegister(effect.second));
+					}
+					registerFile[operation->operand] = 0;
+					executed += static_cast<std::uint64_t>(count) * operation->costs[0];
 				}
-				if (bonsaiRegex.matches<DEC>(line))
+				executed += operation->costs[1];
+				operation = program + operation->targets[1];
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(block, Opcode::BLOCK)
+			{
+				BONSAI_UNFUSED_UNLESS_FITS(operation->targets[1]);
+				for (const auto &effect : registerEffects[operation->operand])
 				{
-					auto args = bonsaiRegex.getArguments<DEC, 1, std::uint32_t>(line);
-					registers.at(args[0])--;
+					registerFile[effect.first] += toRegister(effect.second);
+				}
+				executed += operation->targets[1];
+				operation = program + operation->targets[0];
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(jmp, Opcode::JMP)
+			{
+				BONSAI_UNFUSED_UNLESS_FITS(operation->costs[0]);
+				executed += operation->costs[0];
+				operation = program + operation->operand;
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(add, Opcode::ADD)
+			BONSAI_OPERATION(sub, Opcode::SUB)
+			BONSAI_OPERATION(mov, Opcode::MOV)
+			BONSAI_OPERATION(movn, Opcode::MOVN)
+			BONSAI_OPERATION(cmp, Opcode::CMP)
+			{
+				BONSAI_UNFUSED_UNLESS_FITS(getMacroCost(*operation, registerFile));
+				executed += runMacro(*operation, registerFile);
+				operation = program + operation->targets[1];
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(inc, Opcode::INC)
+			{
+				executed++;
+				registerFile[operation->operand]++;
+				operation++;
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(dec, Opcode::DEC)
+			{
+				executed++;
+				registerFile[operation->operand]--;
+				operation++;
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(interrupt, Opcode::INT)
+			{
+				executed++;
+#ifndef BONSAI_WEB
+				Console::debug << "Interrupt called! Registers: " << (getPrintableRegisters(registerFile) | join(",")) << Console::endl;
+				std::cin.get();
+#endif
+				operation++;
+				BONSAI_DISPATCH();
+			}
+			BONSAI_OPERATION(trap, Opcode::TRAP)
+			{
+				if constexpr (Budgeted)
+					*stoppedAt = static_cast<std::uint32_t>(operation - program);
+				stepCount += executed + 1;
+				return operation->operand + 1;
+			}
+			BONSAI_OPERATION(hlt, Opcode::HLT)
+			{
+				if constexpr (Budgeted)
+					*stoppedAt = static_cast<std::uint32_t>(operation - program);
+				stepCount += executed + 1;
+				return 0;
+			}
+			BONSAI_OPERATION(end, Opcode::END)
+			{
+				if constexpr (Budgeted)
+					*stoppedAt = static_cast<std::uint32_t>(operation - program);
+				stepCount += executed;
+				return 0;
+			}
+#if !(defined(__GNUC__) && !defined(__EMSCRIPTEN__))
 				}
-				if (bonsaiRegex.matches<HLT>(line) || ip >= code.size())
+			}
+#endif
+#undef BONSAI_OPERATION
+#undef BONSAI_DISPATCH
+#undef BONSAI_UNFUSED_UNLESS_FITS
+		[[maybe_unused]] exhausted:
+			stepCount += executed;
+			*stoppedAt = static_cast<std::uint32_t>(operation - program);
+			return budgetExhausted;
+		}
+
+		/*
+			Turns the instrumentation that is switched on into the template arguments of runDecoded, one flag at a time.
+		*/
+		template <bool Budgeted, bool... Flags> RunStatus runInstrumented(std::uint64_t budget = 0)
+		{
+			constexpr auto count = sizeof...(Flags);
+			if constexpr (count == 4)
+				return runDecoded<Flags..., Budgeted>(budget);
+			else
+			{
+				const bool flags[4] = {profiling, trace != nullptr, detectingCycles, debugger != nullptr};
+				return flags[count] ? runInstrumented<Budgeted, Flags..., true>(budget) : runInstrumented<Budgeted, Flags..., false>(budget);
+			}
+		}
+		bool isInstrumented() const
+		{
+			return profiling || trace || detectingCycles || debugger;
+		}
+		/*
+			The profile counts the end markers as well while running, they are dropped once the run (or slice) is over.
+		*/
+		void prepareInstrumentation(bool restartProfile)
+		{
+			if (trace)
+				trace->setAddresses(addresses);
+			if (debugger)
+				debugger->prepare(addresses, operations.size());
+			if (profiling)
+			{
+				if (restartProfile)
+					profile = {};
+
+				profile.executions.resize(operations.size(), 0);
+				profile.taken.resize(operations.size(), 0);
+				profile.isTest.clear();
+				for (const auto &operation : operations)
 				{
+					profile.isTest.push_back(operation.opcode == Opcode::TST);
+				}
+			}
+		}
+		void finishProfile()
+		{
+			if (profiling)
+			{
+				profile.executions.resize(lineCount);
+				profile.taken.resize(lineCount);
+				profile.isTest.resize(lineCount);
+			}
+		}
+		bool runJit()
+		{
+			Jit<Register> jit;
+			if (!jit.compile(operations))
+			{
+#ifndef BONSAI_WEB
+				Console::debug << "Program can't be translated to native code, falling back to the interpreter" << Console::endl;
+#endif
+				return report(runThreaded(registers.data(), steps));
+			}
+
+			return report(jit.run(registers.data(), steps));
+		}
+		bool report(std::uint32_t trap)
+		{
+			if (trap != 0)
+			{
+				errorStack.push_back(printfs("Jmp Destination out of bounds in line %u", trap));
+				return false;
+			}
+			return true;
+		}
+
+		/*
+			8 bit registers would be printed as characters, so everything is shown as 64 bit.
+		*/
+		std::map<std::uint32_t, std::uint64_t> getPrintableRegisters(const Register *registerFile) const
+		{
+			std::map<std::uint32_t, std::uint64_t> rtn;
+			for (const auto &reg : getRegisters(registerFile))
+			{
+				rtn.insert(reg);
+			}
+			return rtn;
+		}
+
+	public:
+		BasicExecutor() { }
+		/*
+			Register changes of loop and block operations are stored as 32 bit two's complement, they are sign extended for wider registers.
+		*/
+		static constexpr Register toRegister(std::uint32_t delta)
+		{
+			return static_cast<Register>(static_cast<std::int64_t>(static_cast<std::int32_t>(delta)));
+		}
+		/*
+			Multiplies in 64 bit and wraps around at the register width, 8 and 16 bit registers would otherwise be promoted to int and overflow.
+		*/
+		static constexpr Register multiply(Register x, Register y)
+		{
+			return static_cast<Register>(static_cast<std::uint64_t>(x) * static_cast<std::uint64_t>(y));
+		}
+		auto getErrorstack()
+		{
+			return errorStack;
+		}
+		std::map<std::uint32_t, Register> getRegisters(const Register *registerFile) const
+		{
+			std::map<std::uint32_t, Register> rtn;
+			for (std::size_t slot = 0; addresses.size() > slot; slot++)
+			{
+				rtn.insert({addresses[slot], registerFile[slot]});
+			}
+			return rtn;
+		}
+		std::map<std::uint32_t, Register> getRegisters()
+		{
+			return getRegisters(registers.data());
+		}
+		auto getSteps()
+		{
+			return steps;
+		}
+		/*
+			The decoded program, operands refer to register slots and the code is followed by two end markers.
+		*/
+		const std::vector<Operation> &getOperations() const
+		{
+			return operations;
+		}
+		const std::vector<std::uint32_t> &getAddresses() const
+		{
+			return addresses;
+		}
+		void setMode(ExecutionMode _mode)
+		{
+			mode = _mode;
+		}
+		/*
+			Counts executions per line and tst outcomes, the code is then always run by the decoded interpreter.
+		*/
+		void setProfiling(bool _profiling)
+		{
+			profiling = _profiling;
+		}
+		const Profile &getProfile()
+		{
+			return profile;
+		}
+		/*
+			Records every register write into buffer, the code is then always run by the decoded interpreter.
+		*/
+		void setTrace(TraceBuffer *buffer)
+		{
+			trace = buffer;
+		}
+		/*
+			Checks the watchpoints and breakpoints of debugger while running, the code is then always run by the decoded interpreter.
+		*/
+		void setDebugger(Debugger *_debugger)
+		{
+			debugger = _debugger;
+		}
+		/*
+			Stops run() with an error once the program repeats a state, the code is then always run by the decoded interpreter.
+		*/
+		void setCycleDetection(bool detect)
+		{
+			detectingCycles = detect;
+			cycleSearch.searching = false;
+		}
+		void setRegister(std::uint32_t id, Register value)
+		{
+			registers[getSlot(id)] = value;
+			cycleSearch.searching = false;
+		}
+		bool load(std::vector<std::string> _code)
+		{
+			code = _code;
+			lineCount = static_cast<std::uint32_t>(code.size());
+			programHash = hashProgram(code);
+			operations.clear();
+			steps = 0;
+			position = 0;
+			status = RunStatus::Exhausted;
+			cycleSearch = {};
+			errorStack.clear();
+			for (std::uint32_t i = 0; code.size() > i; i++)
+			{
+				const auto& line = code[i];
+				if (!EasyBonsai::bonsaiInstructions.matchesAny(line))
+				{
+					errorStack.push_back(printfs("Unkown instruction \"%s\" in line %u", line.c_str(), i));
+				}
+				else
+				{
+					/* Registers are addressed with 32 bits, larger addresses can not be loaded */
+					auto valid = true;
+					for (const auto &arg : EasyBonsai::bonsaiInstructions.getUsedAddys(line))
+					{
+						std::uint32_t address;
+						if (internal::parseNumber(arg, address))
+						{
+							registers[getSlot(address)] = 0;
+						}
+						else
+						{
+							errorStack.push_back(printfs("Register address \"%s\" is out of range in line %u", arg.c_str(), i));
+							valid = false;
+						}
+					}
+					if (valid)
+						operations.push_back(decode(line, i));
+				}
+			}
+
+			/*
+				A tst on the last line may skip past the end of the code, two end markers make sure that both cases stop the execution.
+			*/
+			operations.push_back({Opcode::END, {0, 0}, 0});
+			operations.push_back({Opcode::END, {0, 0}, 0});
+
+			fuse();
+
+			return errorStack.size() <= 0;
+		}
+		/*
+			Builds the decoded operations straight from the records of a binary program, nothing is parsed.
+		*/
+		bool load(const BinaryProgram &program)
+		{
+			code.clear();
+			lineCount = program.getLineCount();
+			programHash = program.getProgramHash();
+			operations.clear();
+			steps = 0;
+			position = 0;
+			status = RunStatus::Exhausted;
+			cycleSearch = {};
+			errorStack.clear();
+			operations.reserve(lineCount + 2);
+
+			std::vector<std::uint32_t> programSlots;
+			programSlots.reserve(program.getRegisterCount());
+			for (std::uint32_t i = 0; program.getRegisterCount() > i; i++)
+			{
+				programSlots.push_back(getSlot(program.getAddress(i)));
+				registers[programSlots.back()] = 0;
+			}
+
+			for (std::uint32_t i = 0; lineCount > i; i++)
+			{
+				auto [opcode, operand] = program.getRecord(i);
+				switch (opcode)
+				{
+				case Opcode::TST:
+				case Opcode::INC:
+				case Opcode::DEC:
+					if (operand >= programSlots.size())
+					{
+						errorStack.push_back(printfs("Invalid register in line %u", i));
+						return false;
+					}
+					operations.push_back({opcode, {1, 1}, programSlots[operand]});
+					break;
+				case Opcode::JMP:
+					operations.push_back(operand >= lineCount ? Operation{Opcode::TRAP, {1, 1}, i} : Operation{Opcode::JMP, {1, 1}, operand});
 					break;
+				case Opcode::HLT:
+				case Opcode::INT:
+					operations.push_back({opcode, {1, 1}, 0});
+					break;
+				default:
+					errorStack.push_back(printfs("Unkown instruction in line %u", i));
+					return false;
 				}
 			}
 
+			operations.push_back({Opcode::END, {0, 0}, 0});
+			operations.push_back({Opcode::END, {0, 0}, 0});
+
+			fuse();
 			return true;
 		}
+		std::uint64_t getProgramHash() const
+		{
+			return programHash;
+		}
+		/*
+			Lets the threaded mode run the compiler templates described by the hints natively, needs to be called after load.
+		*/
+		bool useHints(const Hints &hints)
+		{
+			if (hints.programHash != programHash)
+			{
+				errorStack.push_back("Hints were generated for a different program");
+				return false;
+			}
+
+			macros.clear();
+			auto slotOf = [this](std::uint32_t address) { return (slots | containsKey(address)) ? slots.at(address) : 0; };
+			helpSlots[0] = slotOf(hints.helpRegisters[0]);
+			helpSlots[1] = slotOf(hints.helpRegisters[1]);
+			cmpSlots[0] = slotOf(hints.cmpRegisters[0]);
+			cmpSlots[1] = slotOf(hints.cmpRegisters[1]);
+
+			const Opcode opcodes[] = {Opcode::ADD, Opcode::SUB, Opcode::MOV, Opcode::MOVN, Opcode::CMP};
+			for (const auto &macro : hints.macros)
+			{
+				/*
+					Every register the template touches has to be used by the program.
+					The native implementation is also only equivalent if the arguments do not alias the registers the template uses internally.
+				*/
+				std::vector<std::uint32_t> arguments = {macro.arguments[0]};
+				std::vector<std::uint32_t> internals;
+				if (macro.kind != MacroKind::MOVN)
+				{
+					arguments.push_back(macro.arguments[1]);
+					internals.push_back(hints.helpRegisters[0]);
+				}
+				if (macro.kind == MacroKind::ADD || macro.kind == MacroKind::SUB)
+					internals.push_back(hints.helpRegisters[1]);
+				if (macro.kind == MacroKind::CMP)
+					internals.insert(internals.end(), {hints.cmpRegisters[0], hints.cmpRegisters[1]});
+
+				bool isValid = macro.entry < lineCount && macro.continueAt < lineCount && operations[macro.entry].opcode == Opcode::JMP;
+				for (auto address : arguments)
+					isValid &= (slots | containsKey(address)) && !(internals | contains(address));
+				for (auto address : internals)
+					isValid &= (slots | containsKey(address));
+				if ((macro.kind == MacroKind::MOV || macro.kind == MacroKind::CMP) && arguments[0] == arguments[1])
+					isValid = false;
+
+				if (!isValid)
+				{
+					errorStack.push_back(printfs("Invalid hint for line %u", macro.entry));
+					return false;
+				}
+
+				macros.push_back({macro.entry, {opcodes[static_cast<std::size_t>(macro.kind)], {0, 0}, slots.at(arguments.front()), {slots.at(arguments.back()), macro.continueAt}}});
+			}
+
+			fuse();
+			return true;
+		}
+		bool run()
+		{
+			if (isInstrumented())
+			{
+				prepareInstrumentation(true);
+				auto success = runInstrumented<false>() == RunStatus::Halted;
+				finishProfile();
+				return success;
+			}
+			if (mode == ExecutionMode::Reference && code.empty() && lineCount > 0)
+			{
+#ifndef BONSAI_WEB
+				Console::debug << "Binary programs have no text to interpret, falling back to the decoded interpreter" << Console::endl;
+#endif
+				return runDecoded() == RunStatus::Halted;
+			}
+			if (mode == ExecutionMode::Reference)
+				return runReference();
+			if (mode == ExecutionMode::Decoded)
+				return runDecoded() == RunStatus::Halted;
+			if (mode == ExecutionMode::Jit)
+				return runJit();
+
+			return report(runThreaded(registers.data(), steps));
+		}
+		/*
+			Runs until hlt, an error or until exactly budget more steps were taken, the next call continues where the last one stopped.
+			Uses the threaded interpreter, fused operations that do not fit into the rest of the budget are split up there.
+			The decoded mode, profiling, tracing, cycle detection and debugging run in the decoded interpreter instead. The profile keeps counting across slices.
+			The reference mode and the JIT can not stop in between, they use the threaded interpreter as well.
+		*/
+		RunResult runFor(std::uint64_t budget)
+		{
+			if (status != RunStatus::Exhausted)
+				return {status, position, steps};
+
+			if (isInstrumented() || mode == ExecutionMode::Decoded)
+			{
+				prepareInstrumentation(false);
+				status = runInstrumented<true>(budget);
+				finishProfile();
+				return {status, position, steps};
+			}
+
+			auto result = runThreaded<true>(registers.data(), steps, position, budget, &position);
+			if (result != budgetExhausted)
+				status = report(result) ? RunStatus::Halted : RunStatus::Error;
+
+			return {status, position, steps};
+		}
+		/*
+			The state between two runFor calls.
+		*/
+		Checkpoint getCheckpoint()
+		{
+			Checkpoint rtn{programHash, sizeof(Register) * 8, position, steps, {}};
+			for (std::size_t slot = 0; registers.size() > slot; slot++)
+			{
+				rtn.registers.push_back({addresses[slot], registers[slot]});
+			}
+			return rtn;
+		}
+		/*
+			Needs to be called after load, the next runFor continues where the checkpoint was taken.
+		*/
+		bool restore(const Checkpoint &checkpoint)
+		{
+			if (checkpoint.programHash != programHash || checkpoint.ip >= operations.size())
+			{
+				errorStack.push_back("Checkpoint was taken from a different program");
+				return false;
+			}
+			if (checkpoint.width != sizeof(Register) * 8)
+			{
+				errorStack.push_back(printfs("Checkpoint was taken with %u bit registers", checkpoint.width));
+				return false;
+			}
+
+			for (const auto &reg : checkpoint.registers)
+			{
+				setRegister(reg.first, static_cast<Register>(reg.second));
+			}
+			steps = checkpoint.steps;
+			position = checkpoint.ip;
+			status = RunStatus::Exhausted;
+			cycleSearch.searching = false;
+			return true;
+		}
+		/*
+			Continues a runFor without a budget.
+		*/
+		RunResult resume()
+		{
+			return runFor(std::numeric_limits<std::uint64_t>::max());
+		}
+		/*
+			Runs the loaded program on the given registers (starting from getRegisterFile) and leaves the executor untouched, safe to call from multiple threads at once.
+			Slots behind the ones the program uses are not touched.
+		*/
+		std::uint32_t runShared(std::vector<Register> &registerFile, std::uint64_t &stepCount, std::uint32_t start = 0) const
+		{
+			if (addresses.size() > registerFile.size())
+				registerFile.resize(addresses.size(), 0);
+
+			return runThreaded(registerFile.data(), stepCount, start);
+		}
+		/*
+			The fused program the threaded mode runs and the register changes its loop and block operations refer to.
+		*/
+		const std::vector<Operation> &getThreaded() const
+		{
+			return threaded;
+		}
+		const std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> &getRegisterEffects() const
+		{
+			return registerEffects;
+		}
+		const std::vector<Register> &getRegisterFile() const
+		{
+			return registers;
+		}
+		std::optional<std::uint32_t> findSlot(std::uint32_t address) const
+		{
+			auto slot = slots.find(address);
+			if (slot == slots.end())
+				return std::nullopt;
+
+			return slot->second;
+		}
 	};
-}
\ No newline at end of file
+	using Executor = BasicExecutor<>;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sstream>
+#include <optional>
+
+namespace EasyBonsai
+{
+	enum class MacroKind
+	{
+		ADD,
+		SUB,
+		MOV,
+		MOVN,
+		CMP
+	};
+	/*
+		Lines first..last implement the macro, they are entered through the jmp on line entry and continue execution at continueAt.
+	*/
+	struct MacroHint
+	{
+		MacroKind kind;
+		std::uint32_t entry;
+		std::uint32_t first;
+		std::uint32_t last;
+		std::uint32_t continueAt;
+		std::uint32_t arguments[2];
+	};
+	struct Hints
+	{
+		std::uint64_t programHash = 0;
+		std::uint32_t helpRegisters[2] = {0, 0};
+		std::uint32_t cmpRegisters[2] = {0, 0};
+		std::vector<MacroHint> macros;
+	};
+
+	namespace internal
+	{
+		inline const char *macroNames[] = {"add", "sub", "mov", "movn", "cmp"};
+	}
+
+	inline std::uint64_t hashProgram(const std::vector<std::string> &code)
+	{
+		/*
+			FNV-1a over every line, including the line breaks.
+		*/
+		std::uint64_t hash = 14695981039346656037ull;
+		for (const auto &line : code)
+		{
+			for (auto character : line)
+			{
+				hash ^= static_cast<std::uint8_t>(character);
+				hash *= 1099511628211ull;
+			}
+			hash ^= '\n';
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+	inline std::vector<std::string> serializeHints(const Hints &hints)
+	{
+		std::vector<std::string> rtn;
+
+		std::stringstream hash;
+		hash << std::hex << hints.programHash;
+
+		rtn.push_back("; EasyBonsai3 macro hints - kind entry first last continue arguments...");
+		rtn.push_back("hash " + hash.str());
+		rtn.push_back("help " + std::to_string(hints.helpRegisters[0]) + " " + std::to_string(hints.helpRegisters[1]));
+		rtn.push_back("compare " + std::to_string(hints.cmpRegisters[0]) + " " + std::to_string(hints.cmpRegisters[1]));
+
+		for (const auto &macro : hints.macros)
+		{
+			auto line = std::string(internal::macroNames[static_cast<std::size_t>(macro.kind)]);
+			line += " " + std::to_string(macro.entry) + " " + std::to_string(macro.first) + " " + std::to_string(macro.last) + " " + std::to_string(macro.continueAt);
+			line += " " + std::to_string(macro.arguments[0]);
+			if (macro.kind != MacroKind::MOVN)
+				line += " " + std::to_string(macro.arguments[1]);
+
+			rtn.push_back(line);
+		}
+
+		return rtn;
+	}
+	inline std::optional<Hints> parseHints(const std::vector<std::string> &lines)
+	{
+		Hints rtn;
+		for (const auto &line : lines)
+		{
+			if (line.empty() || line[0] == ';')
+				continue;
+
+			std::string kind;
+			std::istringstream stream(line);
+			stream >> kind;
+
+			if (kind == "hash")
+			{
+				stream >> std::hex >> rtn.programHash;
+			}
+			else if (kind == "help")
+			{
+				stream >> rtn.helpRegisters[0] >> rtn.helpRegisters[1];
+			}
+			else if (kind == "compare")
+			{
+				stream >> rtn.cmpRegisters[0] >> rtn.cmpRegisters[1];
+			}
+			else
+			{
+				MacroHint macro{};
+				std::size_t index = 0;
+				while (sizeof(internal::macroNames) / sizeof(*internal::macroNames) > index && kind != internal::macroNames[index])
+					index++;
+				if (index == sizeof(internal::macroNames) / sizeof(*internal::macroNames))
+					return std::nullopt;
+
+				macro.kind = static_cast<MacroKind>(index);
+				stream >> macro.entry >> macro.first >> macro.last >> macro.continueAt >> macro.arguments[0];
+				if (macro.kind != MacroKind::MOVN)
+					stream >> macro.arguments[1];
+
+				rtn.macros.push_back(macro);
+			}
+
+			if (stream.fail())
+				return std::nullopt;
+		}
+		return rtn;
+	}
+} // namespace EasyBonsai
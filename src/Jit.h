@@ -0,0 +1,243 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "Operation.h"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(__EMSCRIPTEN__)
+#define BONSAI_JIT
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace EasyBonsai
+{
+	/*
+		Translates decoded bonsai into x86-64 machine code.
+		The generated function gets the register file and the step counter, it returns 0 on hlt or at the end of the code and line+1 of a taken out of bounds jump.
+		Register operations use the operand size of Register, so they wrap around like the interpreters do.
+	*/
+	template <typename Register = std::uint32_t> class Jit
+	{
+		static_assert(sizeof(Register) == 1 || sizeof(Register) == 2 || sizeof(Register) == 4 || sizeof(Register) == 8, "Registers are 8, 16, 32 or 64 bit");
+		using Function = std::uint32_t (*)(Register *registers, std::uint64_t *steps);
+
+		/*
+			16 bit operations need the operand size prefix and 64 bit ones REX.W, 8 bit operations have their own opcode.
+		*/
+		static constexpr std::size_t prefixSize = (sizeof(Register) == 2 || sizeof(Register) == 8) ? 1 : 0;
+		static constexpr std::uint8_t immediateOpcode = sizeof(Register) == 1 ? 0x80 : 0x83;
+
+	private:
+		void *memory = nullptr;
+		std::size_t size = 0;
+		std::vector<std::uint8_t> machineCode;
+
+	private:
+		void emit(std::initializer_list<std::uint8_t> bytes)
+		{
+			machineCode.insert(machineCode.end(), bytes.begin(), bytes.end());
+		}
+		void emit32(std::uint32_t value)
+		{
+			for (int i = 0; 4 > i; i++)
+			{
+				machineCode.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+			}
+		}
+		/*
+			op [rdi + displacement], immediate with the register extension selecting add (0), sub (5) or cmp (7).
+		*/
+		void emitRegisterOperation(std::uint8_t extension, std::uint32_t displacement, std::uint8_t immediate)
+		{
+			if constexpr (sizeof(Register) == 2)
+				emit({0x66});
+			if constexpr (sizeof(Register) == 8)
+				emit({0x48});
+
+			emit({immediateOpcode, static_cast<std::uint8_t>(0x87 | (extension << 3))});
+			emit32(displacement);
+			emit({immediate});
+		}
+		void emitJump(std::initializer_list<std::uint8_t> opcode, std::size_t destination)
+		{
+			emit(opcode);
+			emit32(static_cast<std::uint32_t>(destination - (machineCode.size() + 4)));
+		}
+		static std::size_t getSize(Opcode opcode)
+		{
+			switch (opcode)
+			{
+			case Opcode::INC:
+			case Opcode::DEC:
+				return 3 + prefixSize + 7;
+			case Opcode::TST:
+				return 3 + prefixSize + 7 + 6;
+			case Opcode::JMP:
+				return 3 + 5;
+			case Opcode::HLT:
+				return 3 + 2 + 5;
+			case Opcode::TRAP:
+				return 3 + 5 + 5;
+			case Opcode::END:
+				return 2 + 5;
+			default:
+				return 0;
+			}
+		}
+		void release()
+		{
+#ifdef BONSAI_JIT
+			if (memory)
+			{
+#ifdef _WIN32
+				VirtualFree(memory, 0, MEM_RELEASE);
+#else
+				munmap(memory, size);
+#endif
+			}
+#endif
+			memory = nullptr;
+			size = 0;
+		}
+
+	public:
+		Jit() {}
+		Jit(const Jit &) = delete;
+		Jit &operator=(const Jit &) = delete;
+		~Jit()
+		{
+			release();
+		}
+		static constexpr bool isSupported()
+		{
+#ifdef BONSAI_JIT
+			return true;
+#else
+			return false;
+#endif
+		}
+		/*
+			Only plain decoded operations are translated, programs using int are left to the interpreter.
+		*/
+		bool compile(const std::vector<Operation> &operations)
+		{
+			if (!isSupported())
+				return false;
+
+			machineCode.clear();
+			release();
+
+#ifdef _WIN32
+			// push rdi; push rsi; mov rdi, rcx; mov rsi, rdx
+			emit({0x57, 0x56, 0x48, 0x89, 0xCF, 0x48, 0x89, 0xD6});
+#endif
+			// mov r8, [rsi]
+			emit({0x4C, 0x8B, 0x06});
+
+			std::vector<std::size_t> labels;
+			auto offset = machineCode.size();
+			for (const auto &operation : operations)
+			{
+				auto operationSize = getSize(operation.opcode);
+				if (operationSize == 0)
+					return false;
+
+				labels.push_back(offset);
+				offset += operationSize;
+			}
+			auto epilogue = offset;
+
+			for (std::size_t i = 0; operations.size() > i; i++)
+			{
+				const auto &operation = operations[i];
+				auto displacement = static_cast<std::uint32_t>(operation.operand * sizeof(Register));
+
+				if (operation.opcode != Opcode::END)
+				{
+					// inc r8
+					emit({0x49, 0xFF, 0xC0});
+				}
+
+				switch (operation.opcode)
+				{
+				case Opcode::INC:
+					// add [rdi + displacement], 1
+					emitRegisterOperation(0, displacement, 0x01);
+					break;
+				case Opcode::DEC:
+					// sub [rdi + displacement], 1
+					emitRegisterOperation(5, displacement, 0x01);
+					break;
+				case Opcode::TST:
+					// cmp [rdi + displacement], 0; je line + 2
+					emitRegisterOperation(7, displacement, 0x00);
+					emitJump({0x0F, 0x84}, labels[i + 2]);
+					break;
+				case Opcode::JMP:
+					emitJump({0xE9}, labels[operation.operand]);
+					break;
+				case Opcode::TRAP:
+					// mov eax, line + 1
+					emit({0xB8});
+					emit32(operation.operand + 1);
+					emitJump({0xE9}, epilogue);
+					break;
+				default:
+					// xor eax, eax
+					emit({0x31, 0xC0});
+					emitJump({0xE9}, epilogue);
+					break;
+				}
+			}
+
+			// mov [rsi], r8
+			emit({0x4C, 0x89, 0x06});
+#ifdef _WIN32
+			// pop rsi; pop rdi
+			emit({0x5E, 0x5F});
+#endif
+			// ret
+			emit({0xC3});
+
+#ifdef BONSAI_JIT
+			size = machineCode.size();
+#ifdef _WIN32
+			memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (!memory)
+				return false;
+
+			DWORD oldProtection;
+			std::memcpy(memory, machineCode.data(), size);
+			if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &oldProtection))
+			{
+				release();
+				return false;
+			}
+#else
+			memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+			{
+				memory = nullptr;
+				return false;
+			}
+
+			std::memcpy(memory, machineCode.data(), size);
+			if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+			{
+				release();
+				return false;
+			}
+#endif
+#endif
+			return true;
+		}
+		std::uint32_t run(Register *registers, std::uint64_t &steps)
+		{
+			return reinterpret_cast<Function>(memory)(registers, &steps);
+		}
+	};
+} // namespace EasyBonsai
@@ -0,0 +1,605 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <charconv>
+#include <stdexcept>
+#include <optional>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+
+namespace EasyBonsai
+{
+	namespace internal
+	{
+		/*
+			Every instruction form of Bonsai and EasyBonsai, the comments show the pattern each one accepts in ECMAScript regex syntax.
+			As in std::regex, . is any character but '\n' and '\r' and \d is [0-9].
+		*/
+		enum class Pattern : std::uint8_t
+		{
+			TST,	 /* ^tst (\d+)$ */
+			JMP,	 /* ^jmp (\d+)$ */
+			INC,	 /* ^inc (\d+)$ */
+			DEC,	 /* ^dec (\d+)$ */
+			HLT,	 /* ^hlt$ */
+			INT,	 /* ^int$ */
+			LABELN,	 /* ^([a-zA-Z0-9-_]+):$ */
+			JG,		 /* ^jg (.+)$ */
+			GOTO,	 /* ^goto (.+)$ */
+			LABEL,	 /* ^(.+):\ .*$ */
+			JMPTO,	 /* ^jmp \.(.+)$ */
+			JMPR,	 /* ^jmp ([+-]\d+)$ */
+			JE,		 /* ^je (.+)$ */
+			JL,		 /* ^jl (.+)$ */
+			MOVN,	 /* ^mov (\d+)\ *,\ *NULL$ */
+			REG,	 /* ^reg (.+)\ *,\ *(\d+)$ */
+			OR,		 /* ^or (\d+)\ *,\ *(\d+)$ */
+			CMP,	 /* ^cmp (\d+)\ *,\ *(\d+)$ */
+			AND,	 /* ^and (\d+)\ *,\ *(\d+)$ */
+			MOV,	 /* ^mov (\d+),\ *(\d+)\ *$ */
+			ADD,	 /* ^add (\d+),\ *(\d+)\ *$ */
+			SUB,	 /* ^sub (\d+),\ *(\d+)\ *$ */
+			VINC,	 /* ^inc (\d+),\ *(\d+)\ *$ */
+			VDEC,	 /* ^dec (\d+),\ *(\d+)\ *$ */
+			JNE,	 /* ^jne (.+)$ */
+			RET,	 /* ^ret$ */
+			RETV,	 /* ^ret (.+)$ */
+			FUNCDEF, /* ^\(fun (.+)\(([a-zA-Z0-9, ]*)\):\ *$ */
+			PUSH,	 /* ^push (.+)$ */
+			CALL,	 /* ^call (.+)$ */
+			REGA	 /* ^reg (.+)\ *$ */
+		};
+
+		constexpr bool isDigit(char c)
+		{
+			return c >= '0' && c <= '9';
+		}
+		constexpr bool isLetter(char c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+		}
+		constexpr bool isAny(char c)
+		{
+			return c != '\n' && c != '\r';
+		}
+		constexpr bool isAny(std::string_view text)
+		{
+			for (auto c : text)
+			{
+				if (!isAny(c))
+					return false;
+			}
+			return true;
+		}
+		/*
+			-?[0-9]+
+		*/
+		constexpr bool isInteger(std::string_view text)
+		{
+			if (!text.empty() && text[0] == '-')
+				text.remove_prefix(1);
+			if (text.empty())
+				return false;
+
+			for (auto c : text)
+			{
+				if (!isDigit(c))
+					return false;
+			}
+			return true;
+		}
+		/*
+			Reads all of text as a number of type Number, an optional '+' is accepted. Fails for anything else and for values Number can not hold.
+		*/
+		template <typename Number> bool parseNumber(std::string_view text, Number &number)
+		{
+			if (text.size() > 1 && text[0] == '+' && isDigit(text[1]))
+				text.remove_prefix(1);
+
+			auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+			return !text.empty() && error == std::errc() && end == text.data() + text.size();
+		}
+		/*
+			The text in front of the first space, every pattern except the labels starts with its mnemonic.
+		*/
+		constexpr std::string_view getMnemonic(Pattern pattern)
+		{
+			switch (pattern)
+			{
+			case Pattern::TST:
+				return "tst";
+			case Pattern::JMP:
+			case Pattern::JMPTO:
+			case Pattern::JMPR:
+				return "jmp";
+			case Pattern::INC:
+			case Pattern::VINC:
+				return "inc";
+			case Pattern::DEC:
+			case Pattern::VDEC:
+				return "dec";
+			case Pattern::HLT:
+				return "hlt";
+			case Pattern::INT:
+				return "int";
+			case Pattern::JG:
+				return "jg";
+			case Pattern::GOTO:
+				return "goto";
+			case Pattern::JE:
+				return "je";
+			case Pattern::JL:
+				return "jl";
+			case Pattern::MOVN:
+			case Pattern::MOV:
+				return "mov";
+			case Pattern::REG:
+			case Pattern::REGA:
+				return "reg";
+			case Pattern::OR:
+				return "or";
+			case Pattern::CMP:
+				return "cmp";
+			case Pattern::AND:
+				return "and";
+			case Pattern::ADD:
+				return "add";
+			case Pattern::SUB:
+				return "sub";
+			case Pattern::JNE:
+				return "jne";
+			case Pattern::RET:
+			case Pattern::RETV:
+				return "ret";
+			case Pattern::FUNCDEF:
+				return "(fun";
+			case Pattern::PUSH:
+				return "push";
+			case Pattern::CALL:
+				return "call";
+			default:
+				return "";
+			}
+		}
+
+		/*
+			Reads a line from left to right, every method either consumes what it accepts or fails.
+		*/
+		class Cursor
+		{
+		private:
+			std::string_view line;
+			std::size_t position = 0;
+
+		public:
+			constexpr Cursor(std::string_view line) : line(line) {}
+			constexpr bool literal(std::string_view text)
+			{
+				if (line.substr(position, text.size()) != text)
+					return false;
+
+				position += text.size();
+				return true;
+			}
+			/* \d+ */
+			constexpr bool digits(std::string_view &capture)
+			{
+				auto start = position;
+				while (line.size() > position && isDigit(line[position]))
+					position++;
+
+				capture = line.substr(start, position - start);
+				return position > start;
+			}
+			/* \ * */
+			constexpr void spaces()
+			{
+				while (line.size() > position && line[position] == ' ')
+					position++;
+			}
+			/* (.+)$ */
+			constexpr bool rest(std::string_view &capture)
+			{
+				capture = line.substr(position);
+				position = line.size();
+				return !capture.empty() && isAny(capture);
+			}
+			constexpr bool atEnd() const
+			{
+				return position == line.size();
+			}
+		};
+
+		/*
+			Matches line against pattern, captures receives the groups of the pattern in order.
+		*/
+		constexpr bool matchPattern(Pattern pattern, std::string_view line, std::array<std::string_view, 2> &captures)
+		{
+			Cursor cursor(line);
+			auto mnemonic = getMnemonic(pattern);
+			auto prefix = [&]() { return cursor.literal(mnemonic) && cursor.literal(" "); };
+
+			switch (pattern)
+			{
+			case Pattern::TST:
+			case Pattern::JMP:
+			case Pattern::INC:
+			case Pattern::DEC:
+				return prefix() && cursor.digits(captures[0]) && cursor.atEnd();
+			case Pattern::HLT:
+			case Pattern::INT:
+			case Pattern::RET:
+				return line == mnemonic;
+			case Pattern::JG:
+			case Pattern::GOTO:
+			case Pattern::JE:
+			case Pattern::JL:
+			case Pattern::JNE:
+			case Pattern::RETV:
+			case Pattern::PUSH:
+			case Pattern::CALL:
+			case Pattern::REGA:
+				return prefix() && cursor.rest(captures[0]);
+			case Pattern::JMPTO:
+				return prefix() && cursor.literal(".") && cursor.rest(captures[0]);
+			case Pattern::JMPR:
+			{
+				if (!prefix() || !(cursor.literal("+") || cursor.literal("-")))
+					return false;
+
+				std::string_view digits;
+				if (!cursor.digits(digits) || !cursor.atEnd())
+					return false;
+
+				captures[0] = line.substr(4);
+				return true;
+			}
+			case Pattern::MOVN:
+				if (!prefix() || !cursor.digits(captures[0]))
+					return false;
+
+				cursor.spaces();
+				if (!cursor.literal(","))
+					return false;
+
+				cursor.spaces();
+				return cursor.literal("NULL") && cursor.atEnd();
+			case Pattern::OR:
+			case Pattern::CMP:
+			case Pattern::AND:
+				if (!prefix() || !cursor.digits(captures[0]))
+					return false;
+
+				cursor.spaces();
+				if (!cursor.literal(","))
+					return false;
+
+				cursor.spaces();
+				return cursor.digits(captures[1]) && cursor.atEnd();
+			case Pattern::MOV:
+			case Pattern::ADD:
+			case Pattern::SUB:
+			case Pattern::VINC:
+			case Pattern::VDEC:
+				if (!prefix() || !cursor.digits(captures[0]) || !cursor.literal(","))
+					return false;
+
+				cursor.spaces();
+				if (!cursor.digits(captures[1]))
+					return false;
+
+				cursor.spaces();
+				return cursor.atEnd();
+			case Pattern::LABELN:
+			{
+				if (line.size() < 2 || line.back() != ':')
+					return false;
+
+				auto name = line.substr(0, line.size() - 1);
+				for (auto c : name)
+				{
+					if (!isLetter(c) && !isDigit(c) && c != '-' && c != '_')
+						return false;
+				}
+				captures[0] = name;
+				return true;
+			}
+			case Pattern::LABEL:
+			{
+				/* (.+) is greedy, so the label ends at the last ": " */
+				auto separator = line.rfind(": ");
+				if (separator == std::string_view::npos || separator == 0 || !isAny(line))
+					return false;
+
+				captures[0] = line.substr(0, separator);
+				return true;
+			}
+			case Pattern::REG:
+			{
+				/* The name is greedy as well and takes every space up to the last comma */
+				std::string_view rest;
+				if (!prefix() || !cursor.rest(rest))
+					return false;
+
+				auto comma = rest.rfind(',');
+				if (comma == std::string_view::npos || comma == 0)
+					return false;
+
+				Cursor value(rest.substr(comma + 1));
+				value.spaces();
+				if (!value.digits(captures[1]) || !value.atEnd())
+					return false;
+
+				captures[0] = rest.substr(0, comma);
+				return true;
+			}
+			case Pattern::FUNCDEF:
+			{
+				std::string_view rest;
+				if (!prefix() || !cursor.rest(rest))
+					return false;
+
+				auto end = rest.find_last_not_of(' ');
+				if (end == std::string_view::npos || end == 0 || rest[end] != ':' || rest[end - 1] != ')')
+					return false;
+
+				auto head = rest.substr(0, end - 1);
+				auto open = head.rfind('(');
+				if (open == std::string_view::npos || open == 0)
+					return false;
+
+				auto parameters = head.substr(open + 1);
+				for (auto c : parameters)
+				{
+					if (!isLetter(c) && !isDigit(c) && c != ',' && c != ' ')
+						return false;
+				}
+				captures[0] = head.substr(0, open);
+				captures[1] = parameters;
+				return true;
+			}
+			default:
+				return false;
+			}
+		}
+
+		/*
+			A set of instruction forms, an instruction is the index of its form in the set.
+			Only the forms whose mnemonic matches the first word of a line are tried, the table of mnemonics is built once when the set is created.
+		*/
+		class CommandCollection
+		{
+			struct Command
+			{
+				Pattern pattern;
+				std::uint32_t argCount;
+				bool isUseableAddy = true;
+				std::vector<std::uint32_t> ignoredAddys{};
+			};
+
+		private:
+			std::vector<Command> commands;
+			std::vector<std::pair<std::string_view, std::uint32_t>> mnemonics;
+			std::uint32_t withoutMnemonic = 0;
+
+		private:
+			/*
+				A bit for every command that may match line.
+			*/
+			std::uint32_t getCandidates(std::string_view line) const
+			{
+				auto word = line.substr(0, line.find(' '));
+				for (const auto &mnemonic : mnemonics)
+				{
+					if (mnemonic.first == word)
+						return mnemonic.second | withoutMnemonic;
+				}
+				return withoutMnemonic;
+			}
+			/*
+				The index of the first command at or after from that matches line, or commands.size().
+			*/
+			std::size_t findMatching(std::string_view line, std::array<std::string_view, 2> &captures, std::size_t from = 0) const
+			{
+				auto candidates = getCandidates(line) >> from;
+				for (auto i = from; candidates; i++, candidates >>= 1)
+				{
+					if (!(candidates & 1))
+						continue;
+
+					captures = {};
+					if (matchPattern(commands[i].pattern, line, captures))
+						return i;
+				}
+				return commands.size();
+			}
+
+		public:
+			CommandCollection(std::vector<Command> commands) : commands(commands)
+			{
+				for (std::uint32_t i = 0; this->commands.size() > i; i++)
+				{
+					auto mnemonic = getMnemonic(this->commands[i].pattern);
+					if (mnemonic.empty())
+					{
+						withoutMnemonic |= 1u << i;
+						continue;
+					}
+
+					auto known = std::find_if(mnemonics.begin(), mnemonics.end(), [&](const auto &entry) { return entry.first == mnemonic; });
+					if (known == mnemonics.end())
+						mnemonics.push_back({mnemonic, 1u << i});
+					else
+						known->second |= 1u << i;
+				}
+			}
+			bool matchesAny(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				return findMatching(what, captures) != commands.size();
+			}
+			std::optional<Command> getMatching(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				auto index = findMatching(what, captures);
+				if (index == commands.size())
+					return std::nullopt;
+
+				return commands[index];
+			}
+			template <std::size_t instruction>
+			bool matches(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				return matchPattern(commands.at(instruction).pattern, what, captures);
+			}
+			template <typename ReturnType = std::string, std::enable_if_t<std::is_arithmetic<ReturnType>::value || std::is_same<std::string, ReturnType>::value> * = nullptr>
+			std::vector<ReturnType> getUsedAddys(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				std::vector<ReturnType> rtn;
+
+				for (auto index = findMatching(what, captures); commands.size() > index; index = findMatching(what, captures, index + 1))
+				{
+					const auto &command = commands[index];
+					if (!command.isUseableAddy)
+						continue;
+
+					for (std::uint32_t i = 1; command.argCount >= i; i++)
+					{
+						if (std::find(command.ignoredAddys.begin(), command.ignoredAddys.end(), i) != command.ignoredAddys.end())
+							continue;
+
+						/* Groups a pattern does not have are empty */
+						auto capture = captures[i - 1];
+						if constexpr (std::is_arithmetic<ReturnType>::value)
+						{
+							/* Numbers too large for ReturnType are no address of it, negative ones wrap like they always did */
+							std::int64_t number;
+							if (isInteger(capture) && parseNumber(capture, number) && (number < 0 || static_cast<std::uint64_t>(std::numeric_limits<ReturnType>::max()) >= static_cast<std::uint64_t>(number)))
+								rtn.push_back(static_cast<ReturnType>(number));
+						}
+						else
+						{
+							rtn.push_back(std::string(capture));
+						}
+					}
+				}
+
+				return rtn;
+			}
+			template <std::size_t instruction, std::size_t count, typename ReturnType = std::string, std::enable_if_t<std::is_arithmetic<ReturnType>::value || std::is_same<std::string, ReturnType>::value> * = nullptr>
+			std::array<ReturnType, count> getArguments(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				std::array<ReturnType, count> rtn{};
+
+				if (matchPattern(commands.at(instruction).pattern, what, captures))
+				{
+					for (std::size_t i = 1; count >= i; i++)
+					{
+						if constexpr (std::is_arithmetic<ReturnType>::value)
+						{
+							if (!parseNumber(captures[i - 1], rtn[i - 1]))
+								throw std::out_of_range("Argument \"" + std::string(captures[i - 1]) + "\" is out of range");
+						}
+						else
+						{
+							rtn[i - 1] = std::string(captures[i - 1]);
+						}
+					}
+				}
+				return rtn;
+			}
+			/*
+				Like getArguments, but returns nothing if what is not the instruction.
+			*/
+			template <std::size_t instruction, std::size_t count>
+			std::optional<std::array<std::string, count>> matchArguments(const std::string &what) const
+			{
+				std::array<std::string_view, 2> captures;
+				if (!matchPattern(commands.at(instruction).pattern, what, captures))
+					return std::nullopt;
+
+				std::array<std::string, count> rtn;
+				for (std::size_t i = 1; count >= i; i++)
+				{
+					rtn[i - 1] = std::string(captures[i - 1]);
+				}
+				return rtn;
+			}
+		};
+	} // namespace internal
+
+	inline const internal::CommandCollection bonsaiInstructions({{internal::Pattern::TST, 1},
+																  {internal::Pattern::JMP, 1, false},
+																  {internal::Pattern::INC, 1},
+																  {internal::Pattern::DEC, 1},
+																  {internal::Pattern::HLT, 0, false},
+																  {internal::Pattern::INT, 0, false}});
+	inline const internal::CommandCollection easyBonsaiInstructions(
+		{{internal::Pattern::LABELN, 1, false},
+		 {internal::Pattern::JG, 1, false},
+		 {internal::Pattern::GOTO, 1, false},
+		 {internal::Pattern::LABEL, 1, false},
+		 {internal::Pattern::JMPTO, 1, false},
+		 {internal::Pattern::JMPR, 1, false},
+		 {internal::Pattern::JE, 1, false},
+		 {internal::Pattern::JL, 1, false},
+		 {internal::Pattern::MOVN, 1},
+		 {internal::Pattern::REG, 2},
+		 {internal::Pattern::OR, 2},
+		 {internal::Pattern::CMP, 2},
+		 {internal::Pattern::AND, 2},
+		 {internal::Pattern::MOV, 2},
+		 {internal::Pattern::ADD, 2},
+		 {internal::Pattern::SUB, 2},
+		 {internal::Pattern::VINC, 2, true, {2}},
+		 {internal::Pattern::VDEC, 2, true, {2}},
+		 {internal::Pattern::JNE, 1, false},
+		 {internal::Pattern::RET, 0, false},
+		 {internal::Pattern::RETV, 1},
+		 {internal::Pattern::FUNCDEF, 2, false},
+		 {internal::Pattern::PUSH, 2},
+		 {internal::Pattern::CALL, 1, false},
+		 {internal::Pattern::REGA, 1}});
+
+	enum Instruction
+	{
+		LABELN,
+		JG,
+		GOTO,
+		LABEL,
+		JMPTO,
+		JMPR,
+		JE,
+		JL,
+		MOVN,
+		REG,
+		OR,
+		CMP,
+		AND,
+		MOV,
+		ADD,
+		SUB,
+		VINC,
+		VDEC,
+		JNE,
+		RET,
+		RETV,
+		FUNCDEF,
+		PUSH,
+		CALL,
+		REGA,
+		TST = 0,
+		JMP,
+		INC,
+		DEC,
+		HLT,
+		INT
+	};
+} // namespace EasyBonsai
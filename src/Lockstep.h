@@ -0,0 +1,315 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include "Executor.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BONSAI_AVX2
+#elif (defined(__SSE2__) || defined(_M_X64)) && !defined(__EMSCRIPTEN__)
+#include <emmintrin.h>
+#define BONSAI_SSE2
+#endif
+
+namespace EasyBonsai
+{
+	namespace internal
+	{
+		/*
+			Kernels over Width consecutive lanes of one register, AVX2 is used when the build enables it, SSE2 on every other x86-64 build.
+			Other register widths use plain loops, which compilers vectorize on their own.
+		*/
+		template <std::size_t Width, typename Register> inline void addLanes(Register *lanes, const Register *increments)
+		{
+			if constexpr (std::is_same_v<Register, std::uint32_t>)
+			{
+#if defined(BONSAI_AVX2)
+				for (std::size_t i = 0; Width > i; i += 8)
+				{
+					auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes + i));
+					auto increment = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(increments + i));
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes + i), _mm256_add_epi32(value, increment));
+				}
+				return;
+#elif defined(BONSAI_SSE2)
+				for (std::size_t i = 0; Width > i; i += 4)
+				{
+					auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + i));
+					auto increment = _mm_loadu_si128(reinterpret_cast<const __m128i *>(increments + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + i), _mm_add_epi32(value, increment));
+				}
+				return;
+#endif
+			}
+			for (std::size_t i = 0; Width > i; i++)
+			{
+				lanes[i] += increments[i];
+			}
+		}
+		template <std::size_t Width, typename Register> inline void subLanes(Register *lanes, const Register *increments)
+		{
+			if constexpr (std::is_same_v<Register, std::uint32_t>)
+			{
+#if defined(BONSAI_AVX2)
+				for (std::size_t i = 0; Width > i; i += 8)
+				{
+					auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes + i));
+					auto increment = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(increments + i));
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes + i), _mm256_sub_epi32(value, increment));
+				}
+				return;
+#elif defined(BONSAI_SSE2)
+				for (std::size_t i = 0; Width > i; i += 4)
+				{
+					auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + i));
+					auto increment = _mm_loadu_si128(reinterpret_cast<const __m128i *>(increments + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + i), _mm_sub_epi32(value, increment));
+				}
+				return;
+#endif
+			}
+			for (std::size_t i = 0; Width > i; i++)
+			{
+				lanes[i] -= increments[i];
+			}
+		}
+		/*
+			One bit per lane that is zero.
+		*/
+		template <std::size_t Width, typename Register> inline std::uint32_t zeroLanes(const Register *lanes)
+		{
+			std::uint32_t rtn = 0;
+			if constexpr (std::is_same_v<Register, std::uint32_t>)
+			{
+#if defined(BONSAI_AVX2)
+				for (std::size_t i = 0; Width > i; i += 8)
+				{
+					auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes + i));
+					auto zero = _mm256_cmpeq_epi32(value, _mm256_setzero_si256());
+					rtn |= static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(zero))) << i;
+				}
+				return rtn;
+#elif defined(BONSAI_SSE2)
+				for (std::size_t i = 0; Width > i; i += 4)
+				{
+					auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + i));
+					auto zero = _mm_cmpeq_epi32(value, _mm_setzero_si128());
+					rtn |= static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(zero))) << i;
+				}
+				return rtn;
+#endif
+			}
+			for (std::size_t i = 0; Width > i; i++)
+			{
+				rtn |= static_cast<std::uint32_t>(lanes[i] == 0) << i;
+			}
+			return rtn;
+		}
+		inline std::uint32_t countLanes(std::uint32_t mask)
+		{
+			std::uint32_t rtn = 0;
+			for (; mask; mask &= mask - 1)
+				rtn++;
+			return rtn;
+		}
+	} // namespace internal
+
+	/*
+		Runs up to Width inputs through the fused program at once, every register holds one value per input (lane).
+		As long as all lanes take the same branches they share one instruction pointer, when a branch disagrees the smaller group leaves and finishes on the scalar interpreter.
+		inc/dec only change active lanes, so lanes that left keep their registers.
+	*/
+	template <std::size_t Width, typename Register = std::uint32_t> class Lockstep
+	{
+		static_assert(Width == 8 || Width == 16, "Lockstep runs 8 or 16 lanes");
+
+	private:
+		const BasicExecutor<Register> &executor;
+
+	public:
+		Lockstep(const BasicExecutor<Register> &executor) : executor(executor) {}
+		static constexpr const char *getKernel()
+		{
+			if constexpr (!std::is_same_v<Register, std::uint32_t>)
+				return "scalar";
+#if defined(BONSAI_AVX2)
+			return "AVX2";
+#elif defined(BONSAI_SSE2)
+			return "SSE2";
+#else
+			return "scalar";
+#endif
+		}
+		/*
+			registerFiles are laid out like Executor::runShared expects them, at most Width of them are run.
+			steps and traps receive what runShared would have returned for every input.
+		*/
+		void run(std::vector<std::vector<Register>> &registerFiles, std::vector<std::uint64_t> &steps, std::vector<std::uint32_t> &traps) const
+		{
+			const auto &program = executor.getThreaded();
+			const auto &registerEffects = executor.getRegisterEffects();
+			auto slotCount = executor.getAddresses().size();
+			auto count = std::min(registerFiles.size(), Width);
+
+			std::vector<Register> lanes(slotCount * Width, 0);
+			Register increments[Width] = {};
+			std::uint64_t extraSteps[Width] = {};
+			std::uint32_t active = 0;
+
+			steps.assign(count, 0);
+			traps.assign(count, 0);
+			for (std::size_t lane = 0; count > lane; lane++)
+			{
+				registerFiles[lane].resize(std::max(registerFiles[lane].size(), slotCount), 0);
+				for (std::size_t slot = 0; slotCount > slot; slot++)
+				{
+					lanes[slot * Width + lane] = registerFiles[lane][slot];
+				}
+				increments[lane] = 1;
+				active |= 1u << lane;
+			}
+
+			std::uint32_t ip = 0;
+			std::uint64_t executed = 0;
+
+			auto store = [&](std::size_t lane, std::uint64_t cost) {
+				for (std::size_t slot = 0; slotCount > slot; slot++)
+				{
+					registerFiles[lane][slot] = lanes[slot * Width + lane];
+				}
+				steps[lane] = executed + extraSteps[lane] + cost;
+				increments[lane] = 0;
+				active &= ~(1u << lane);
+			};
+			auto leave = [&](std::uint32_t mask, std::uint32_t start, std::uint64_t cost) {
+				for (std::size_t lane = 0; count > lane; lane++)
+				{
+					if (!(mask & (1u << lane)))
+						continue;
+
+					store(lane, cost);
+					traps[lane] = executor.runShared(registerFiles[lane], steps[lane], start);
+				}
+			};
+			auto finish = [&](std::uint32_t trap) {
+				for (std::size_t lane = 0; count > lane; lane++)
+				{
+					if (!(active & (1u << lane)))
+						continue;
+
+					store(lane, 0);
+					traps[lane] = trap;
+				}
+			};
+			auto branch = [&](std::uint32_t zero, std::uint32_t notZeroTarget, std::uint64_t notZeroCost, std::uint32_t zeroTarget, std::uint64_t zeroCost) {
+				if (zero == 0 || zero == active)
+				{
+					executed += zero ? zeroCost : notZeroCost;
+					ip = zero ? zeroTarget : notZeroTarget;
+					return;
+				}
+
+				auto notZero = active & ~zero;
+				auto zeroStays = internal::countLanes(zero) >= internal::countLanes(notZero);
+				if (zeroStays)
+				{
+					leave(notZero, notZeroTarget, notZeroCost);
+					executed += zeroCost;
+					ip = zeroTarget;
+				}
+				else
+				{
+					leave(zero, zeroTarget, zeroCost);
+					executed += notZeroCost;
+					ip = notZeroTarget;
+				}
+			};
+
+			auto lanesOf = [&](std::uint32_t slot) { return lanes.data() + static_cast<std::size_t>(slot) * Width; };
+			while (active)
+			{
+				const auto &operation = program[ip];
+
+				switch (operation.opcode)
+				{
+				case Opcode::INC:
+					internal::addLanes<Width>(lanesOf(operation.operand), increments);
+					executed++;
+					ip++;
+					break;
+				case Opcode::DEC:
+					internal::subLanes<Width>(lanesOf(operation.operand), increments);
+					executed++;
+					ip++;
+					break;
+				case Opcode::TST:
+					branch(internal::zeroLanes<Width>(lanesOf(operation.operand)) & active, ip + 1, 1, ip + 2, 1);
+					break;
+				case Opcode::BRANCH:
+					branch(internal::zeroLanes<Width>(lanesOf(operation.operand)) & active, operation.targets[0], operation.costs[0], operation.targets[1], operation.costs[1]);
+					break;
+				case Opcode::JMP:
+					executed += operation.costs[0];
+					ip = operation.operand;
+					break;
+				case Opcode::BLOCK:
+					for (const auto &effect : registerEffects[operation.operand])
+					{
+						auto *effectLanes = lanesOf(effect.first);
+						for (std::size_t lane = 0; Width > lane; lane++)
+						{
+							effectLanes[lane] += BasicExecutor<Register>::multiply(BasicExecutor<Register>::toRegister(effect.second), increments[lane]);
+						}
+					}
+					executed += operation.targets[1];
+					ip = operation.targets[0];
+					break;
+				case Opcode::LOOP:
+				{
+					/*
+						The iteration count differs per lane, so do the steps it takes.
+					*/
+					Register counts[Width];
+					auto *registerLanes = lanesOf(operation.operand);
+					for (std::size_t lane = 0; Width > lane; lane++)
+					{
+						counts[lane] = BasicExecutor<Register>::multiply(registerLanes[lane], increments[lane]);
+						registerLanes[lane] -= counts[lane];
+						extraSteps[lane] += static_cast<std::uint64_t>(counts[lane]) * operation.costs[0];
+					}
+					for (const auto &effect : registerEffects[operation.targets[0]])
+					{
+						auto *effectLanes = lanesOf(effect.first);
+						for (std::size_t lane = 0; Width > lane; lane++)
+						{
+							effectLanes[lane] += BasicExecutor<Register>::multiply(counts[lane], BasicExecutor<Register>::toRegister(effect.second));
+						}
+					}
+					executed += operation.costs[1];
+					ip = operation.targets[1];
+					break;
+				}
+				case Opcode::HLT:
+					executed++;
+					finish(0);
+					break;
+				case Opcode::END:
+					finish(0);
+					break;
+				case Opcode::TRAP:
+					executed++;
+					finish(operation.operand + 1);
+					break;
+				default:
+					/*
+						int and the macro operations are left to the scalar interpreter.
+					*/
+					leave(active, ip, 0);
+					break;
+				}
+			}
+		}
+	};
+} // namespace EasyBonsai
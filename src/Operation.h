@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+namespace EasyBonsai
+{
+	enum class Opcode : std::uint8_t
+	{
+		TST,
+		JMP,
+		INC,
+		DEC,
+		HLT,
+		INT,
+		TRAP,
+		END,
+		BRANCH,
+		ADD,
+		SUB,
+		MOV,
+		MOVN,
+		CMP,
+		LOOP,
+		BLOCK
+	};
+	enum class RunStatus
+	{
+		Halted,
+		Exhausted,
+		Error
+	};
+	struct Operation
+	{
+		Opcode opcode;
+		/*
+			Amount of bonsai-steps the operation stands for, the second entry is used for the zero-branch of a fused tst.
+		*/
+		std::uint8_t costs[2];
+		std::uint32_t operand;
+		std::uint32_t targets[2] = {0, 0};
+	};
+} // namespace EasyBonsai
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace EasyBonsai
+{
+	/*
+		Execution counts per bonsai line, for every tst taken counts how often it skipped the next line.
+	*/
+	struct Profile
+	{
+		std::vector<std::uint64_t> executions;
+		std::vector<std::uint64_t> taken;
+		std::vector<bool> isTest;
+	};
+
+	namespace internal
+	{
+		inline std::string escapeJson(const std::string &text)
+		{
+			std::string rtn;
+			for (auto character : text)
+			{
+				if (character == '"' || character == '\\')
+					rtn += '\\';
+				if (static_cast<unsigned char>(character) < 0x20)
+					continue;
+				rtn += character;
+			}
+			return rtn;
+		}
+	}
+
+	/*
+		Indices of all executed lines, the most executed line first.
+	*/
+	inline std::vector<std::size_t> getHotspots(const Profile &profile)
+	{
+		std::vector<std::size_t> rtn;
+		for (std::size_t i = 0; profile.executions.size() > i; i++)
+		{
+			if (profile.executions[i] > 0)
+				rtn.push_back(i);
+		}
+		std::stable_sort(rtn.begin(), rtn.end(), [&](std::size_t a, std::size_t b) { return profile.executions[a] > profile.executions[b]; });
+		return rtn;
+	}
+	inline std::string serializeProfile(const Profile &profile, const std::vector<std::string> &code, std::uint64_t steps, double seconds)
+	{
+		auto stepsPerSecond = seconds > 0 ? static_cast<std::uint64_t>(steps / seconds) : 0;
+
+		std::string rtn = "{\n";
+		rtn += "\t\"steps\": " + std::to_string(steps) + ",\n";
+		rtn += "\t\"seconds\": " + std::to_string(seconds) + ",\n";
+		rtn += "\t\"stepsPerSecond\": " + std::to_string(stepsPerSecond) + ",\n";
+		rtn += "\t\"lines\": [";
+
+		auto hotspots = getHotspots(profile);
+		for (std::size_t i = 0; hotspots.size() > i; i++)
+		{
+			auto line = hotspots[i];
+			rtn += i ? ",\n\t\t" : "\n\t\t";
+			rtn += "{\"line\": " + std::to_string(line) + ", \"code\": \"" + internal::escapeJson(code[line]) + "\", \"executions\": " + std::to_string(profile.executions[line]);
+			if (profile.isTest[line])
+				rtn += ", \"taken\": " + std::to_string(profile.taken[line]) + ", \"notTaken\": " + std::to_string(profile.executions[line] - profile.taken[line]);
+			rtn += "}";
+		}
+
+		rtn += hotspots.empty() ? "]\n}\n" : "\n\t]\n}\n";
+		return rtn;
+	}
+} // namespace EasyBonsai
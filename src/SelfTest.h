@@ -0,0 +1,353 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include "Executor.h"
+#include "Lockstep.h"
+#include "belegpp/belegpp.h"
+
+namespace EasyBonsai
+{
+	/*
+		A small program and the registers it starts with.
+	*/
+	struct SelfTestProgram
+	{
+		std::string name;
+		std::vector<std::string> code;
+		std::vector<std::pair<std::uint32_t, std::uint64_t>> registers;
+	};
+	/*
+		An easy bonsai program, lines (index and text) its compiled code has to contain and lines that have to be jumps out of the compiled code.
+	*/
+	struct SelfTestCompilation
+	{
+		std::string name;
+		std::vector<std::string> code;
+		std::vector<std::pair<std::size_t, std::string>> expected;
+		std::vector<std::size_t> outOfBounds;
+	};
+
+	namespace internal
+	{
+		/*
+			The programs cover wrap around at every width, fused branches, loops and blocks, a counted loop whose change does not fit into an int at 16 bit, jump chains, sparse addresses, a tst that skips past the end and a taken out of bounds jump.
+		*/
+		inline const std::vector<SelfTestProgram> &getSelfTestPrograms()
+		{
+			static const std::vector<SelfTestProgram> programs = {
+				{"add", {"tst 1", "jmp 3", "jmp 6", "dec 1", "inc 0", "jmp 0", "hlt"}, {{0, 250}, {1, 10}}},
+				{"multiply", {"tst 0", "jmp 3", "hlt", "dec 0", "tst 1", "jmp 7", "jmp 11", "dec 1", "inc 2", "inc 3", "jmp 4", "tst 3", "jmp 14", "jmp 0", "dec 3", "inc 1", "jmp 11"}, {{0, 20}, {1, 20}}},
+				{"blocks", {"tst 2", "jmp 3", "hlt", "dec 2", "inc 0", "inc 0", "inc 0", "inc 0", "inc 0", "dec 1", "dec 1", "dec 1", "jmp 0"}, {{2, 100}}},
+				{"underflow", {"dec 0", "tst 0", "jmp 4", "hlt", "inc 1", "hlt"}, {}},
+				{"jump chain", {"jmp 2", "hlt", "jmp 4", "hlt", "inc 0", "jmp 1"}, {}},
+				{"sparse addresses", {"inc 4294967295", "inc 7", "dec 3000000000", "inc 4294967295", "tst 12"}, {}},
+				{"out of bounds", {"inc 0", "tst 0", "jmp 7", "hlt"}, {}},
+				{"long counted loop", {"tst 0", "jmp 3", "jmp 6", "dec 0", "dec 1", "jmp 0", "hlt"}, {{0, 65535}}},
+			};
+			return programs;
+		}
+
+		/*
+			Jumps and labels pointing at lines the compiler removes and the jumps of function calls, the results are the ones of removing the lines one at a time.
+			Jumps and labels in front of the remaining code have no line to move to, they have to stay a taken out of bounds jump.
+		*/
+		inline const std::vector<SelfTestCompilation> &getSelfTestCompilations()
+		{
+			static const std::vector<SelfTestCompilation> compilations = {
+				{"jmp to a removed first line", {"reg a, 0", "inc a", "jmp 0"}, {{0, "inc 0"}}, {1}},
+				{"jmp behind removed first lines", {"reg a, 0", "reg b, 1", "reg c, 2", "reg d, 3", "inc a", "inc b", "jmp 1"}, {{0, "inc 0"}, {1, "inc 1"}}, {2}},
+				{"label on a removed first line", {"reg a, 0", "reg b, 1", "(fun f(x):", "inc x", ")", "mid:", "push a", "call f", "push b", "call f", "jmp .mid"}, {{0, "jmp 3"}, {1, "jmp 4"}, {3, "inc 0"}, {4, "inc 1"}}, {2}},
+				{"jne with a sign", {"reg a, 0", "reg b, 1", "cmp a, b", "jne +3", "inc a", "hlt"}, {{35, "tst 6"}, {36, "jmp 2"}, {37, "jmp 1"}}, {}},
+				{"relative jumps over removed lines", {"jmp +3", "reg a, 0", "reg b, 1", "inc a", "jmp -3", "inc b"}, {{0, "jmp 1"}, {1, "inc 0"}, {2, "jmp 0"}, {3, "inc 1"}}, {}},
+				{"ret behind a removed push", {"reg a, 2", "(fun f(x):", "inc x", "jmp +2", "ret x", "ret", ")", "push a", "call f", "jmp -1", "hlt"}, {{0, "jmp 3"}, {1, "jmp 0"}, {3, "inc 2"}, {4, "jmp 6"}, {5, "jmp 7"}, {6, "jmp 1"}, {8, "jmp 1"}}, {}},
+				{"je to a label with digits", {"reg a, 0", "reg b, 1", "cmp a, b", "je .end2", "inc a", "end2: hlt"}, {{2, "inc 0"}, {3, "hlt"}, {35, "tst 6"}, {36, "jmp 3"}, {37, "jmp 2"}}, {}},
+			};
+			return compilations;
+		}
+
+		/*
+			How a run is done: run() in mode, or runFor in slices of a few steps with or without profiling.
+			Reloaded runs in slices once, loads the program again into the same executor and describes the second run.
+		*/
+		enum class SelfTestRun
+		{
+			Whole,
+			Sliced,
+			SlicedProfiling,
+			Reloaded
+		};
+
+		/*
+			Everything that decides the outcome of a run, two runs agree when their descriptions are equal.
+		*/
+		template <typename Register> std::string describeRun(const SelfTestProgram &program, ExecutionMode mode, SelfTestRun kind = SelfTestRun::Whole)
+		{
+			BasicExecutor<Register> executor;
+			executor.setMode(mode);
+			executor.setProfiling(kind == SelfTestRun::SlicedProfiling);
+
+			auto success = true;
+			for (auto round = kind == SelfTestRun::Reloaded ? 2 : 1; round > 0; round--)
+			{
+				if (!executor.load(program.code))
+					return "load failed: " + (executor.getErrorstack() | join(", "));
+
+				for (const auto &reg : program.registers)
+				{
+					executor.setRegister(reg.first, static_cast<Register>(reg.second));
+				}
+
+				if (kind == SelfTestRun::Whole)
+					success = executor.run();
+				else
+				{
+					RunResult result;
+					do
+					{
+						result = executor.runFor(7);
+					} while (result.status == RunStatus::Exhausted);
+					success = result.status == RunStatus::Halted;
+				}
+			}
+
+			auto rtn = success ? std::string("halted") : "failed (" + (executor.getErrorstack() | join(", ")) + ")";
+			rtn += printfs(" after %llu steps,", static_cast<unsigned long long>(executor.getSteps()));
+			for (const auto &reg : executor.getRegisters())
+			{
+				rtn += printfs(" [$%u]: %llu", reg.first, static_cast<unsigned long long>(reg.second));
+			}
+			return rtn;
+		}
+		/*
+			Runs every program in every mode and in slices and compares the results against the reference interpreter.
+		*/
+		template <typename Register> void checkModes(std::vector<std::string> &failures, std::size_t &checks)
+		{
+			struct Mode
+			{
+				const char *name;
+				ExecutionMode mode;
+				SelfTestRun kind;
+			};
+			const Mode modes[] = {{"Decoded", ExecutionMode::Decoded, SelfTestRun::Whole}, {"Threaded", ExecutionMode::Threaded, SelfTestRun::Whole}, {"Jit", ExecutionMode::Jit, SelfTestRun::Whole}, {"Sliced", ExecutionMode::Threaded, SelfTestRun::Sliced}, {"Sliced profiling", ExecutionMode::Threaded, SelfTestRun::SlicedProfiling}, {"Reloaded", ExecutionMode::Threaded, SelfTestRun::Reloaded}};
+			for (const auto &program : getSelfTestPrograms())
+			{
+				auto expected = describeRun<Register>(program, ExecutionMode::Reference);
+				for (const auto &mode : modes)
+				{
+					checks++;
+					auto actual = describeRun<Register>(program, mode.mode, mode.kind);
+					if (actual != expected)
+						failures.push_back(printfs("%s (%s, %u bit): expected %s, got %s", program.name.c_str(), mode.name, static_cast<unsigned>(sizeof(Register) * 8), expected.c_str(), actual.c_str()));
+				}
+			}
+		}
+		/*
+			Runs every program on 8 equal inputs in lockstep, so the lanes never split, and compares every lane against runShared.
+		*/
+		template <typename Register> void checkLockstep(std::vector<std::string> &failures, std::size_t &checks)
+		{
+			for (const auto &program : getSelfTestPrograms())
+			{
+				BasicExecutor<Register> executor;
+				if (!executor.load(program.code))
+					continue;
+
+				for (const auto &reg : program.registers)
+				{
+					executor.setRegister(reg.first, static_cast<Register>(reg.second));
+				}
+
+				auto describe = [](std::uint32_t trap, std::uint64_t steps, const std::vector<Register> &registerFile) {
+					auto rtn = printfs("trap %u after %llu steps,", trap, static_cast<unsigned long long>(steps));
+					for (auto value : registerFile)
+					{
+						rtn += printfs(" %llu", static_cast<unsigned long long>(value));
+					}
+					return rtn;
+				};
+
+				auto scalarFile = executor.getRegisterFile();
+				std::uint64_t scalarSteps = 0;
+				auto scalarTrap = executor.runShared(scalarFile, scalarSteps);
+				auto expected = describe(scalarTrap, scalarSteps, scalarFile);
+
+				std::vector<std::vector<Register>> registerFiles(8, executor.getRegisterFile());
+				std::vector<std::uint64_t> steps(8, 0);
+				std::vector<std::uint32_t> traps(8, 0);
+				Lockstep<8, Register>(executor).run(registerFiles, steps, traps);
+
+				checks++;
+				for (std::size_t lane = 0; 8 > lane; lane++)
+				{
+					auto actual = describe(traps[lane], steps[lane], registerFiles[lane]);
+					if (actual != expected)
+					{
+						failures.push_back(printfs("%s (Lockstep lane %zu, %u bit): expected %s, got %s", program.name.c_str(), lane, static_cast<unsigned>(sizeof(Register) * 8), expected.c_str(), actual.c_str()));
+						break;
+					}
+				}
+			}
+		}
+		/*
+			Threaded slices have to stop after exactly as many steps as decoded ones, even in the middle of fused branches, loops, blocks and macros.
+			The state of both is compared after every slice, a loop over 4000000000 rounds makes sure a slice never runs a whole loop at once.
+		*/
+		inline void checkBudgets(std::vector<std::string> &failures, std::size_t &checks)
+		{
+			auto programs = getSelfTestPrograms();
+			programs.push_back({"huge counted loop", {"tst 0", "jmp 3", "jmp 6", "dec 0", "inc 1", "jmp 0", "hlt"}, {{0, 4000000000u}}});
+
+			/* The macros only exist with the hints of the compiler */
+			Compiler compiler;
+			auto macros = compiler.compile({"reg a, 0", "reg b, 1", "reg c, 2", "reg d, 7", "mov c, a", "add c, b", "add d, c", "sub d, b", "mov a, NULL", "cmp c, d", "hlt"});
+			auto hints = compiler.getHints();
+			if (macros.first)
+				programs.push_back({"macros", macros.second, {{0, 30}, {1, 40}}});
+			else
+				failures.push_back("macros: compilation failed: " + (macros.second | join(", ")));
+
+			auto describe = [](Executor &executor, const RunResult &result) {
+				auto rtn = printfs("status %d at line %u after %llu steps,", static_cast<int>(result.status), result.ip, static_cast<unsigned long long>(result.steps));
+				for (const auto &reg : executor.getRegisters())
+				{
+					rtn += printfs(" [$%u]: %u", reg.first, reg.second);
+				}
+				return rtn;
+			};
+
+			for (const auto &program : programs)
+			{
+				for (std::uint64_t slice : {1ull, 7ull, 100ull, 1000003ull})
+				{
+					checks++;
+					Executor threaded, decoded;
+					threaded.load(program.code);
+					decoded.load(program.code);
+					if (program.name == "macros")
+						threaded.useHints(hints);
+					decoded.setMode(ExecutionMode::Decoded);
+					for (const auto &reg : program.registers)
+					{
+						threaded.setRegister(reg.first, static_cast<std::uint32_t>(reg.second));
+						decoded.setRegister(reg.first, static_cast<std::uint32_t>(reg.second));
+					}
+
+					for (int round = 1; 40 >= round; round++)
+					{
+						auto expectedResult = decoded.runFor(slice);
+						auto expected = describe(decoded, expectedResult);
+						auto actual = describe(threaded, threaded.runFor(slice));
+						if (actual != expected)
+						{
+							failures.push_back(printfs("%s (slice %d of %llu steps): expected %s, got %s", program.name.c_str(), round, static_cast<unsigned long long>(slice), expected.c_str(), actual.c_str()));
+							break;
+						}
+						if (expectedResult.status != RunStatus::Exhausted)
+							break;
+					}
+				}
+			}
+		}
+		/*
+			Budgeted runs have to find a cycle exactly like run() does, no matter how short their slices are.
+			The second program moves 250 between two registers and back, its cycle of 2504 steps is longer than most of the slices.
+		*/
+		inline void checkCycleDetection(std::vector<std::string> &failures, std::size_t &checks)
+		{
+			const std::vector<SelfTestProgram> programs = {
+				{"inc dec", {"inc 0", "dec 0", "jmp 0"}, {}},
+				{"move back and forth", {"tst 0", "jmp 3", "jmp 6", "dec 0", "inc 1", "jmp 0", "tst 1", "jmp 9", "jmp 0", "dec 1", "inc 0", "jmp 6"}, {{0, 250}}},
+			};
+			for (const auto &program : programs)
+			{
+				Executor whole;
+				whole.load(program.code);
+				for (const auto &reg : program.registers)
+				{
+					whole.setRegister(reg.first, static_cast<std::uint32_t>(reg.second));
+				}
+				whole.setCycleDetection(true);
+				whole.run();
+				auto expected = whole.getErrorstack() | join(", ");
+
+				for (std::uint64_t slice : {1ull, 7ull, 100ull, 1ull << 24})
+				{
+					checks++;
+					Executor executor;
+					executor.load(program.code);
+					for (const auto &reg : program.registers)
+					{
+						executor.setRegister(reg.first, static_cast<std::uint32_t>(reg.second));
+					}
+					executor.setCycleDetection(true);
+
+					/* Like --max-steps 100000000 */
+					const std::uint64_t maxSteps = 100000000;
+					RunResult result;
+					do
+					{
+						result = executor.runFor(std::min<std::uint64_t>(slice, maxSteps - executor.getSteps()));
+					} while (result.status == RunStatus::Exhausted && maxSteps > executor.getSteps());
+
+					auto actual = result.status == RunStatus::Error ? executor.getErrorstack() | join(", ") : printfs("no cycle after %llu steps", static_cast<unsigned long long>(executor.getSteps()));
+					if (actual != expected)
+						failures.push_back(printfs("%s (cycle detection in slices of %llu steps): expected %s, got %s", program.name.c_str(), static_cast<unsigned long long>(slice), expected.c_str(), actual.c_str()));
+				}
+			}
+		}
+		inline void checkCompilations(std::vector<std::string> &failures, std::size_t &checks)
+		{
+			for (const auto &compilation : getSelfTestCompilations())
+			{
+				checks++;
+				auto result = Compiler().compile(compilation.code);
+				if (!result.first)
+				{
+					failures.push_back(printfs("%s: compilation failed: %s", compilation.name.c_str(), (result.second | join(", ")).c_str()));
+					continue;
+				}
+
+				for (const auto &line : compilation.expected)
+				{
+					auto actual = result.second.size() > line.first ? result.second[line.first] : std::string("nothing");
+					if (actual != line.second)
+						failures.push_back(printfs("%s: expected \"%s\" in line %zu, got \"%s\"", compilation.name.c_str(), line.second.c_str(), line.first, actual.c_str()));
+				}
+				for (auto line : compilation.outOfBounds)
+				{
+					auto actual = result.second.size() > line ? result.second[line] : std::string("nothing");
+					std::uint64_t target = 0;
+					if (actual.rfind("jmp ", 0) != 0 || !internal::parseNumber(actual.substr(4), target) || result.second.size() > target)
+						failures.push_back(printfs("%s: expected a jump out of the code in line %zu, got \"%s\"", compilation.name.c_str(), line, actual.c_str()));
+				}
+			}
+		}
+	}
+
+	/*
+		Checks that every execution mode, the JIT and lockstep included, agrees with the reference interpreter at every register width, that budgeted runs stop after exactly their budget and find cycles and that the compiler moves jumps like it should.
+		Returns a description of every check that failed, checks is set to the number of checks that ran.
+	*/
+	inline std::vector<std::string> runSelfTest(std::size_t &checks)
+	{
+		std::vector<std::string> failures;
+		checks = 0;
+
+		internal::checkModes<std::uint8_t>(failures, checks);
+		internal::checkModes<std::uint16_t>(failures, checks);
+		internal::checkModes<std::uint32_t>(failures, checks);
+		internal::checkModes<std::uint64_t>(failures, checks);
+		internal::checkLockstep<std::uint8_t>(failures, checks);
+		internal::checkLockstep<std::uint16_t>(failures, checks);
+		internal::checkLockstep<std::uint32_t>(failures, checks);
+		internal::checkLockstep<std::uint64_t>(failures, checks);
+		internal::checkBudgets(failures, checks);
+		internal::checkCycleDetection(failures, checks);
+		internal::checkCompilations(failures, checks);
+
+		return failures;
+	}
+}
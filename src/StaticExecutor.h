@@ -0,0 +1,205 @@
+#pragma once
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <string_view>
+#include "Operation.h"
+
+namespace EasyBonsai
+{
+	/*
+		A parsed program, operands are register addresses and not slots like in Executor.
+		If a line is not a bonsai instruction or the text does not have exactly Lines lines, valid is false and errorLine holds the index of the first line that does not fit.
+	*/
+	template <std::size_t Lines> struct StaticProgram
+	{
+		std::array<Operation, Lines> operations{};
+		bool valid = true;
+		std::size_t errorLine = 0;
+	};
+	/*
+		errorLine is the line Executor would report, it is only set if status is RunStatus::Error.
+	*/
+	template <std::size_t Registers, typename Register = std::uint32_t> struct StaticResult
+	{
+		RunStatus status = RunStatus::Halted;
+		std::uint32_t errorLine = 0;
+		std::uint64_t steps = 0;
+		std::array<Register, Registers> registers{};
+	};
+
+	namespace internal
+	{
+		/*
+			Reads the digits at the end of line starting at offset, numbers past the uint32 range saturate.
+		*/
+		constexpr bool parseStaticNumber(std::string_view line, std::size_t offset, std::uint64_t &number)
+		{
+			if (offset >= line.size())
+				return false;
+
+			number = 0;
+			for (auto i = offset; line.size() > i; i++)
+			{
+				if (line[i] < '0' || line[i] > '9')
+					return false;
+
+				number = number * 10 + static_cast<std::uint64_t>(line[i] - '0');
+				if (number > std::numeric_limits<std::uint32_t>::max())
+					number = static_cast<std::uint64_t>(std::numeric_limits<std::uint32_t>::max()) + 1;
+			}
+			return true;
+		}
+		/*
+			Calls callback for every line the way the command line reads a file: lines starting with ';' are skipped and a trailing line break does not start another line.
+		*/
+		template <typename Callback> constexpr void forEachStaticLine(std::string_view text, Callback &&callback)
+		{
+			std::size_t start = 0;
+			while (text.size() > start)
+			{
+				auto end = text.find('\n', start);
+				if (end == std::string_view::npos)
+					end = text.size();
+
+				auto line = text.substr(start, end - start);
+				if (line.empty() || line[0] != ';')
+					callback(line);
+
+				start = end + 1;
+			}
+		}
+	} // namespace internal
+
+	/*
+		The amount of lines parseStatic needs room for.
+	*/
+	constexpr std::size_t countLines(std::string_view text)
+	{
+		std::size_t rtn = 0;
+		internal::forEachStaticLine(text, [&](std::string_view) { rtn++; });
+		return rtn;
+	}
+	/*
+		Decodes text like Executor::load does, out of bounds jumps become traps that remember their line.
+	*/
+	template <std::size_t Lines> constexpr StaticProgram<Lines> parseStatic(std::string_view text)
+	{
+		StaticProgram<Lines> rtn;
+		std::size_t index = 0;
+		internal::forEachStaticLine(text, [&](std::string_view line) {
+			if (index >= Lines)
+			{
+				if (rtn.valid)
+					rtn.errorLine = index;
+				rtn.valid = false;
+				index++;
+				return;
+			}
+
+			auto &operation = rtn.operations[index];
+			std::uint64_t number = 0;
+			operation = {Opcode::HLT, {1, 1}, 0, {0, 0}};
+
+			auto valid = true;
+			if (line == "hlt")
+				operation.opcode = Opcode::HLT;
+			else if (line == "int")
+				operation.opcode = Opcode::INT;
+			else if (line.size() > 4 && line[3] == ' ' && internal::parseStaticNumber(line, 4, number))
+			{
+				auto name = line.substr(0, 3);
+				operation.operand = static_cast<std::uint32_t>(number);
+				if (name == "tst")
+					operation.opcode = Opcode::TST;
+				else if (name == "inc")
+					operation.opcode = Opcode::INC;
+				else if (name == "dec")
+					operation.opcode = Opcode::DEC;
+				else if (name == "jmp")
+				{
+					operation.opcode = number >= Lines ? Opcode::TRAP : Opcode::JMP;
+					operation.operand = number >= Lines ? static_cast<std::uint32_t>(index) : static_cast<std::uint32_t>(number);
+				}
+				else
+					valid = false;
+
+				if (operation.opcode != Opcode::JMP && operation.opcode != Opcode::TRAP && number > std::numeric_limits<std::uint32_t>::max())
+					valid = false;
+			}
+			else
+				valid = false;
+
+			if (!valid && rtn.valid)
+			{
+				rtn.valid = false;
+				rtn.errorLine = index;
+			}
+			index++;
+		});
+
+		if (index < Lines && rtn.valid)
+		{
+			rtn.valid = false;
+			rtn.errorLine = index;
+		}
+		return rtn;
+	}
+	/*
+		Runs operations with the semantics of BasicExecutor<Register>::run, registers are indexed by address.
+		An operand outside of the registers is reported like an out of bounds jump of its line, maxSteps keeps code that never halts from running until the compiler gives up.
+	*/
+	template <std::size_t Registers, std::size_t Lines, typename Register = std::uint32_t>
+	constexpr StaticResult<Registers, Register> runStatic(const std::array<Operation, Lines> &operations, const std::array<Register, Registers> &registers = {}, std::uint64_t maxSteps = std::numeric_limits<std::uint64_t>::max())
+	{
+		StaticResult<Registers, Register> rtn;
+		rtn.registers = registers;
+
+		std::size_t ip = 0;
+		while (Lines > ip)
+		{
+			if (rtn.steps >= maxSteps)
+			{
+				rtn.status = RunStatus::Exhausted;
+				return rtn;
+			}
+
+			const auto &operation = operations[ip++];
+			rtn.steps++;
+
+			auto usesRegister = operation.opcode == Opcode::TST || operation.opcode == Opcode::INC || operation.opcode == Opcode::DEC;
+			if ((usesRegister && operation.operand >= Registers) || (operation.opcode == Opcode::JMP && operation.operand >= Lines))
+			{
+				rtn.status = RunStatus::Error;
+				rtn.errorLine = static_cast<std::uint32_t>(ip);
+				return rtn;
+			}
+
+			switch (operation.opcode)
+			{
+			case Opcode::TST:
+				if (rtn.registers[operation.operand] == 0)
+					ip++;
+				break;
+			case Opcode::JMP:
+				ip = operation.operand;
+				break;
+			case Opcode::INC:
+				rtn.registers[operation.operand]++;
+				break;
+			case Opcode::DEC:
+				rtn.registers[operation.operand]--;
+				break;
+			case Opcode::TRAP:
+				rtn.status = RunStatus::Error;
+				rtn.errorLine = operation.operand + 1;
+				return rtn;
+			case Opcode::INT:
+				break;
+			default:
+				return rtn;
+			}
+		}
+		return rtn;
+	}
+} // namespace EasyBonsai
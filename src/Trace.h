@@ -0,0 +1,227 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <optional>
+#include <algorithm>
+
+#ifndef BONSAI_WEB
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define BONSAI_OPEN _open
+#define BONSAI_WRITE _write
+#define BONSAI_CLOSE _close
+#define BONSAI_EXIT _exit
+#define BONSAI_TRACE_FLAGS (_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY)
+#else
+#include <unistd.h>
+#define BONSAI_OPEN open
+#define BONSAI_WRITE write
+#define BONSAI_CLOSE close
+#define BONSAI_EXIT _exit
+#define BONSAI_TRACE_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#endif
+#endif
+
+namespace EasyBonsai
+{
+	/*
+		One register write: the line that wrote, the register slot and the new value.
+	*/
+	struct TraceRecord
+	{
+		std::uint32_t ip;
+		std::uint32_t slot;
+		std::uint32_t value;
+	};
+	static_assert(sizeof(TraceRecord) == 12, "Trace records are written as they are");
+
+	/*
+		Keeps the last records in a fixed buffer, the capacity is a power of two so wrapping is a mask.
+		A dump is laid out as:
+			"BTRC", version, capacity, slot count, written records (u64), address of every slot, records oldest first
+		All values are little endian.
+	*/
+	class TraceBuffer
+	{
+	private:
+		std::vector<TraceRecord> records;
+		std::vector<std::uint32_t> addresses;
+		std::uint64_t written = 0;
+		std::uint64_t mask = 0;
+
+		static constexpr char magic[4] = {'B', 'T', 'R', 'C'};
+		static constexpr std::uint32_t version = 1;
+
+		static inline TraceBuffer *signalBuffer = nullptr;
+		static inline int signalFile = -1;
+
+	private:
+		std::vector<std::uint8_t> getHeader() const
+		{
+			std::vector<std::uint8_t> rtn(magic, magic + 4);
+			auto append = [&](const void *data, std::size_t size) {
+				auto bytes = static_cast<const std::uint8_t *>(data);
+				rtn.insert(rtn.end(), bytes, bytes + size);
+			};
+
+			auto capacity = static_cast<std::uint32_t>(records.size());
+			auto slotCount = static_cast<std::uint32_t>(addresses.size());
+			append(&version, 4);
+			append(&capacity, 4);
+			append(&slotCount, 4);
+			append(&written, 8);
+			append(addresses.data(), addresses.size() * 4);
+			return rtn;
+		}
+#ifndef BONSAI_WEB
+		/*
+			Only uses write, so nothing has to be allocated inside of the signal handler.
+		*/
+		static void dumpOnSignal(int signal)
+		{
+			if (signalBuffer && signalFile >= 0)
+			{
+				signalBuffer->writeRecords(signalFile);
+				BONSAI_CLOSE(signalFile);
+			}
+			BONSAI_EXIT(128 + signal);
+		}
+		void writeRecords(int file)
+		{
+			auto capacity = static_cast<std::uint64_t>(records.size());
+			auto count = std::min<std::uint64_t>(written, capacity);
+			auto start = (written - count) & mask;
+			auto tail = std::min<std::uint64_t>(count, capacity - start);
+			std::uint32_t sizes[2] = {static_cast<std::uint32_t>(capacity), static_cast<std::uint32_t>(addresses.size())};
+
+			BONSAI_WRITE(file, magic, 4);
+			BONSAI_WRITE(file, &version, 4);
+			BONSAI_WRITE(file, sizes, 8);
+			BONSAI_WRITE(file, &written, 8);
+			BONSAI_WRITE(file, addresses.data(), static_cast<unsigned>(addresses.size() * 4));
+			BONSAI_WRITE(file, records.data() + start, static_cast<unsigned>(tail * sizeof(TraceRecord)));
+			BONSAI_WRITE(file, records.data(), static_cast<unsigned>((count - tail) * sizeof(TraceRecord)));
+		}
+#endif
+
+	public:
+		TraceBuffer(std::uint32_t capacity = 1 << 16)
+		{
+			std::uint64_t size = 1;
+			while (size < capacity)
+				size <<= 1;
+
+			records.resize(size);
+			mask = size - 1;
+		}
+		void setAddresses(const std::vector<std::uint32_t> &_addresses)
+		{
+			addresses = _addresses;
+		}
+		void clear()
+		{
+			written = 0;
+		}
+		inline void record(std::uint32_t ip, std::uint32_t slot, std::uint32_t value)
+		{
+			records[written++ & mask] = {ip, slot, value};
+		}
+		std::uint64_t getWritten() const
+		{
+			return written;
+		}
+		std::uint64_t getCapacity() const
+		{
+			return records.size();
+		}
+		/*
+			Oldest record first.
+		*/
+		std::vector<TraceRecord> getRecords() const
+		{
+			auto count = std::min<std::uint64_t>(written, records.size());
+			std::vector<TraceRecord> rtn;
+			for (auto i = written - count; written > i; i++)
+			{
+				rtn.push_back(records[i & mask]);
+			}
+			return rtn;
+		}
+		std::vector<std::uint8_t> serialize() const
+		{
+			auto rtn = getHeader();
+			for (const auto &record : getRecords())
+			{
+				auto bytes = reinterpret_cast<const std::uint8_t *>(&record);
+				rtn.insert(rtn.end(), bytes, bytes + sizeof(TraceRecord));
+			}
+			return rtn;
+		}
+#ifndef BONSAI_WEB
+		/*
+			Dumps the buffer into file and exits when the process is interrupted or terminated while running.
+		*/
+		void dumpOnSignals(const std::string &file)
+		{
+			signalFile = BONSAI_OPEN(file.c_str(), BONSAI_TRACE_FLAGS, 0644);
+			if (signalFile < 0)
+				return;
+
+			signalBuffer = this;
+			std::signal(SIGINT, dumpOnSignal);
+			std::signal(SIGTERM, dumpOnSignal);
+		}
+		void stopDumpOnSignals()
+		{
+			std::signal(SIGINT, SIG_DFL);
+			std::signal(SIGTERM, SIG_DFL);
+			if (signalFile >= 0)
+				BONSAI_CLOSE(signalFile);
+
+			signalFile = -1;
+			signalBuffer = nullptr;
+		}
+#endif
+	};
+
+	/*
+		Turns a dump back into one line per record, returns nothing if the dump is malformed.
+	*/
+	inline std::optional<std::vector<std::string>> decodeTrace(const std::vector<std::uint8_t> &dump)
+	{
+		auto read32 = [&](std::size_t offset) {
+			std::uint32_t rtn;
+			std::memcpy(&rtn, dump.data() + offset, 4);
+			return rtn;
+		};
+
+		if (dump.size() < 24 || std::memcmp(dump.data(), "BTRC", 4) != 0 || read32(4) != 1)
+			return std::nullopt;
+
+		auto slotCount = read32(12);
+		std::uint64_t written;
+		std::memcpy(&written, dump.data() + 16, 8);
+
+		auto offset = 24 + static_cast<std::size_t>(slotCount) * 4;
+		if (dump.size() < offset || (dump.size() - offset) % sizeof(TraceRecord) != 0)
+			return std::nullopt;
+
+		auto count = (dump.size() - offset) / sizeof(TraceRecord);
+		std::vector<std::string> rtn;
+		rtn.push_back("Showing the last " + std::to_string(count) + " of " + std::to_string(written) + " register writes");
+		for (std::size_t i = 0; count > i; i++)
+		{
+			TraceRecord record;
+			std::memcpy(&record, dump.data() + offset + i * sizeof(TraceRecord), sizeof(TraceRecord));
+
+			auto address = slotCount > record.slot ? std::to_string(read32(24 + record.slot * 4)) : "?" + std::to_string(record.slot);
+			rtn.push_back("#" + std::to_string(written - count + i) + " line " + std::to_string(record.ip) + ": [$" + address + "] = " + std::to_string(record.value));
+		}
+		return rtn;
+	}
+} // namespace EasyBonsai
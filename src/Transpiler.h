@@ -0,0 +1,446 @@
+#pragma once
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Operation.h"
+
+namespace EasyBonsai
+{
+	/*
+		Turns decoded bonsai into code that can be built once and run at native speed.
+		Operands of the decoded operations are register slots, addresses maps them back to bonsai addresses.
+	*/
+	class Transpiler
+	{
+	private:
+		std::vector<Operation> operations;
+		std::vector<std::uint32_t> addresses;
+
+	private:
+		std::set<std::uint32_t> getJumpTargets()
+		{
+			std::set<std::uint32_t> rtn;
+			for (std::uint32_t i = 0; operations.size() > i; i++)
+			{
+				const auto &operation = operations[i];
+				if (operation.opcode == Opcode::JMP)
+					rtn.insert(operation.operand);
+				if (operation.opcode == Opcode::TST)
+					rtn.insert(i + 2);
+			}
+			return rtn;
+		}
+		std::vector<std::uint32_t> getLeaders()
+		{
+			auto targets = getJumpTargets();
+			targets.insert(0);
+
+			std::vector<std::uint32_t> rtn;
+			for (auto target : targets)
+			{
+				if (operations.size() > target)
+					rtn.push_back(target);
+			}
+			return rtn;
+		}
+		static void writeUnsigned(std::vector<std::uint8_t> &output, std::uint64_t value)
+		{
+			do
+			{
+				std::uint8_t byte = value & 0x7F;
+				value >>= 7;
+				output.push_back(value ? byte | 0x80 : byte);
+			} while (value);
+		}
+		static void writeSigned(std::vector<std::uint8_t> &output, std::int64_t value)
+		{
+			while (true)
+			{
+				std::uint8_t byte = value & 0x7F;
+				value >>= 7;
+				if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)))
+				{
+					output.push_back(byte);
+					return;
+				}
+				output.push_back(byte | 0x80);
+			}
+		}
+		static void writeName(std::vector<std::uint8_t> &output, const std::string &name)
+		{
+			writeUnsigned(output, name.size());
+			output.insert(output.end(), name.begin(), name.end());
+		}
+		static void writeSection(std::vector<std::uint8_t> &output, std::uint8_t id, const std::vector<std::uint8_t> &content)
+		{
+			output.push_back(id);
+			writeUnsigned(output, content.size());
+			output.insert(output.end(), content.begin(), content.end());
+		}
+		/*
+			Body of the exported run function, every leader is the end of one block inside of the dispatch loop.
+			Forward jumps branch to the end of the target block directly, backward jumps go through the br_table.
+		*/
+		std::vector<std::uint8_t> getWasmBody(std::uint32_t interrupt)
+		{
+			auto leaders = getLeaders();
+			std::vector<std::uint32_t> leaderOf(operations.size(), 0);
+			for (std::uint32_t i = 0; leaders.size() > i; i++)
+			{
+				leaderOf[leaders[i]] = i;
+			}
+
+			const std::uint32_t pc = 0, stepCount = 1;
+			const std::uint8_t i32 = 0x7F, i64 = 0x7E, block = 0x02, loop = 0x03, ifBlock = 0x04, end = 0x0B, br = 0x0C, brTable = 0x0E, call = 0x10, ret = 0x0F;
+			const std::uint8_t localGet = 0x20, localSet = 0x21, globalGet = 0x23, globalSet = 0x24, i32Load = 0x28, i32Store = 0x36;
+			const std::uint8_t i32Const = 0x41, i64Const = 0x42, i32Eqz = 0x45, i32Add = 0x6A, i32Sub = 0x6B, i64Add = 0x7C, unreachable = 0x00, empty = 0x40;
+
+			std::vector<std::uint8_t> rtn;
+			/* locals: pc, steps */
+			rtn.insert(rtn.end(), {0x02, 0x01, i32, 0x01, i64});
+			rtn.insert(rtn.end(), {globalGet, 0x00, localSet, stepCount});
+
+			rtn.insert(rtn.end(), {loop, empty});
+			for (std::size_t i = 0; leaders.size() > i; i++)
+			{
+				rtn.insert(rtn.end(), {block, empty});
+			}
+			rtn.insert(rtn.end(), {localGet, pc, brTable});
+			writeUnsigned(rtn, leaders.size());
+			for (std::size_t i = 0; leaders.size() > i; i++)
+			{
+				writeUnsigned(rtn, i);
+			}
+			writeUnsigned(rtn, leaders.size());
+			rtn.push_back(end);
+
+			std::uint32_t current = 0;
+			auto jump = [&](std::uint32_t target, std::uint32_t nesting) {
+				auto leader = leaderOf[target];
+				if (leader > current)
+				{
+					rtn.push_back(br);
+					writeUnsigned(rtn, leader - current - 1 + nesting);
+					return;
+				}
+				rtn.push_back(i32Const);
+				writeSigned(rtn, leader);
+				rtn.insert(rtn.end(), {localSet, pc, br});
+				writeUnsigned(rtn, leaders.size() - current - 1 + nesting);
+			};
+			auto exit = [&](std::uint32_t code) {
+				rtn.insert(rtn.end(), {localGet, stepCount, globalSet, 0x00, i32Const});
+				writeSigned(rtn, static_cast<std::int32_t>(code));
+				rtn.push_back(ret);
+			};
+			auto address = [&](std::uint32_t slot) {
+				/* align 4, offset slot * 4 */
+				rtn.push_back(0x02);
+				writeUnsigned(rtn, static_cast<std::uint64_t>(slot) * 4);
+			};
+
+			for (std::uint32_t i = 0; operations.size() > i; i++)
+			{
+				const auto &operation = operations[i];
+				if (leaderOf[i] != 0)
+				{
+					current = leaderOf[i];
+					rtn.push_back(end);
+				}
+
+				if (operation.opcode != Opcode::END)
+					rtn.insert(rtn.end(), {localGet, stepCount, i64Const, 0x01, i64Add, localSet, stepCount});
+
+				switch (operation.opcode)
+				{
+				case Opcode::TST:
+					rtn.insert(rtn.end(), {i32Const, 0x00, i32Load});
+					address(operation.operand);
+					rtn.insert(rtn.end(), {i32Eqz, ifBlock, empty});
+					jump(i + 2, 1);
+					rtn.push_back(end);
+					break;
+				case Opcode::JMP:
+					jump(operation.operand, 0);
+					break;
+				case Opcode::INC:
+				case Opcode::DEC:
+					rtn.insert(rtn.end(), {i32Const, 0x00, i32Const, 0x00, i32Load});
+					address(operation.operand);
+					rtn.insert(rtn.end(), {i32Const, 0x01, operation.opcode == Opcode::INC ? i32Add : i32Sub, i32Store});
+					address(operation.operand);
+					break;
+				case Opcode::INT:
+					rtn.insert(rtn.end(), {localGet, stepCount, globalSet, 0x00, call});
+					writeUnsigned(rtn, interrupt);
+					break;
+				case Opcode::TRAP:
+					exit(operation.operand + 1);
+					break;
+				default:
+					exit(0);
+					break;
+				}
+			}
+
+			rtn.insert(rtn.end(), {end, unreachable, end});
+			return rtn;
+		}
+
+	public:
+		Transpiler(std::vector<Operation> operations, std::vector<std::uint32_t> addresses) : operations(operations), addresses(addresses) {}
+		std::string toC()
+		{
+			auto lines = operations.size() - 2;
+			auto registerCount = std::to_string(std::max<std::size_t>(addresses.size(), 1));
+
+			std::string addressTable;
+			for (std::size_t i = 0; addresses.size() > i; i++)
+			{
+				addressTable += (i ? ", " : "") + std::to_string(addresses[i]);
+			}
+
+			std::string rtn =
+				"/*\n"
+				"\tGenerated by EasyBonsai3 from " + std::to_string(lines) + " lines of bonsai.\n"
+				"\tBuild: cc -O2 program.c -o program\n"
+				"\tUsage: ./program --setVars register:value,register:value\n"
+				"*/\n"
+				"#include <stdio.h>\n"
+				"#include <stdlib.h>\n"
+				"#include <string.h>\n"
+				"#include <stdint.h>\n"
+				"\n"
+				"#define REGISTER_COUNT " + registerCount + "\n"
+				"static uint32_t r[REGISTER_COUNT];\n"
+				"static const uint32_t addresses[REGISTER_COUNT] = {" + (addresses.empty() ? "0" : addressTable) + "};\n"
+				"static const size_t usedRegisters = " + std::to_string(addresses.size()) + ";\n"
+				"\n"
+				"/* Registers that are set by --setVars but never used by the program are still printed */\n"
+				"static uint32_t *extraAddresses, *extraValues;\n"
+				"static size_t extraCount;\n"
+				"\n"
+				"typedef struct\n"
+				"{\n"
+				"\tuint32_t address, value;\n"
+				"} Register;\n"
+				"\n"
+				"static void setRegister(uint32_t address, uint32_t value)\n"
+				"{\n"
+				"\tsize_t i;\n"
+				"\tfor (i = 0; i < usedRegisters; i++)\n"
+				"\t\tif (addresses[i] == address)\n"
+				"\t\t{\n"
+				"\t\t\tr[i] = value;\n"
+				"\t\t\treturn;\n"
+				"\t\t}\n"
+				"\tfor (i = 0; i < extraCount; i++)\n"
+				"\t\tif (extraAddresses[i] == address)\n"
+				"\t\t{\n"
+				"\t\t\textraValues[i] = value;\n"
+				"\t\t\treturn;\n"
+				"\t\t}\n"
+				"\textraAddresses = realloc(extraAddresses, (extraCount + 1) * sizeof(uint32_t));\n"
+				"\textraValues = realloc(extraValues, (extraCount + 1) * sizeof(uint32_t));\n"
+				"\textraAddresses[extraCount] = address;\n"
+				"\textraValues[extraCount++] = value;\n"
+				"}\n"
+				"static int compareRegisters(const void *a, const void *b)\n"
+				"{\n"
+				"\tuint32_t x = ((const Register *)a)->address, y = ((const Register *)b)->address;\n"
+				"\treturn (x > y) - (x < y);\n"
+				"}\n"
+				"static void printRegisters(const char *separator)\n"
+				"{\n"
+				"\tsize_t i, count = usedRegisters + extraCount;\n"
+				"\tRegister *all = malloc((count + 1) * sizeof(Register));\n"
+				"\tfor (i = 0; i < usedRegisters; i++)\n"
+				"\t\tall[i].address = addresses[i], all[i].value = r[i];\n"
+				"\tfor (i = 0; i < extraCount; i++)\n"
+				"\t\tall[usedRegisters + i].address = extraAddresses[i], all[usedRegisters + i].value = extraValues[i];\n"
+				"\tqsort(all, count, sizeof(Register), compareRegisters);\n"
+				"\tfor (i = 0; i < count; i++)\n"
+				"\t\tprintf(\"[$%lu]: %lu%s\", (unsigned long)all[i].address, (unsigned long)all[i].value, separator);\n"
+				"\tfree(all);\n"
+				"}\n"
+				"static int isNumber(const char *text)\n"
+				"{\n"
+				"\tif (*text == '-')\n"
+				"\t\ttext++;\n"
+				"\tif (!*text)\n"
+				"\t\treturn 0;\n"
+				"\tfor (; *text; text++)\n"
+				"\t\tif (*text < '0' || *text > '9')\n"
+				"\t\t\treturn 0;\n"
+				"\treturn 1;\n"
+				"}\n"
+				"static int setVars(char *vars)\n"
+				"{\n"
+				"\tchar *var;\n"
+				"\tif (!strchr(vars, ':'))\n"
+				"\t\treturn 0;\n"
+				"\tfor (var = strtok(vars, \",\"); var; var = strtok(NULL, \",\"))\n"
+				"\t{\n"
+				"\t\tchar *value = strchr(var, ':'), *end;\n"
+				"\t\tif (!value)\n"
+				"\t\t\tcontinue;\n"
+				"\t\t*value++ = 0;\n"
+				"\t\tif ((end = strchr(value, ':')))\n"
+				"\t\t\t*end = 0;\n"
+				"\t\tif (isNumber(var) && isNumber(value))\n"
+				"\t\t\tsetRegister((uint32_t)strtol(var, NULL, 10), (uint32_t)strtol(value, NULL, 10));\n"
+				"\t}\n"
+				"\treturn 1;\n"
+				"}\n"
+				"\n"
+				"static int run(void)\n"
+				"{\n";
+
+			auto targets = getJumpTargets();
+			for (std::uint32_t i = 0; operations.size() > i; i++)
+			{
+				const auto &operation = operations[i];
+				auto slot = "r[" + std::to_string(operation.operand) + "]";
+
+				if (targets.count(i))
+					rtn += "L" + std::to_string(i) + ":\n";
+
+				switch (operation.opcode)
+				{
+				case Opcode::TST:
+					rtn += "\tif (" + slot + " == 0)\n\t\tgoto L" + std::to_string(i + 2) + ";\n";
+					break;
+				case Opcode::JMP:
+					rtn += "\tgoto L" + std::to_string(operation.operand) + ";\n";
+					break;
+				case Opcode::INC:
+					rtn += "\t" + slot + "++;\n";
+					break;
+				case Opcode::DEC:
+					rtn += "\t" + slot + "--;\n";
+					break;
+				case Opcode::INT:
+					rtn += "\tprintf(\"Interrupt called! Registers: \");\n\tprintRegisters(\" \");\n\tprintf(\"\\n\");\n\tgetchar();\n";
+					break;
+				case Opcode::TRAP:
+					rtn += "\tfprintf(stderr, \"Jmp Destination out of bounds in line " + std::to_string(operation.operand + 1) + "\\n\");\n\treturn 1;\n";
+					break;
+				default:
+					rtn += "\treturn 0;\n";
+					break;
+				}
+			}
+
+			rtn +=
+				"}\n"
+				"\n"
+				"int main(int argc, char **argv)\n"
+				"{\n"
+				"\tint i;\n"
+				"\tfor (i = 1; i + 1 < argc; i++)\n"
+				"\t{\n"
+				"\t\tif (strcmp(argv[i], \"--setVars\") == 0 && !setVars(argv[i + 1]))\n"
+				"\t\t{\n"
+				"\t\t\tfprintf(stderr, \"Invalid setVars format\\n\");\n"
+				"\t\t\treturn 1;\n"
+				"\t\t}\n"
+				"\t}\n"
+				"\tif (run() != 0)\n"
+				"\t\treturn 1;\n"
+				"\n"
+				"\tprintf(\"Registers after execution: \\n\");\n"
+				"\tprintRegisters(\"\\n\");\n"
+				"\treturn 0;\n"
+				"}\n";
+
+			return rtn;
+		}
+		/*
+			Builds a webassembly module that exports:
+				memory: the registers as u32 by slot starting at 0, followed by the bonsai address of every slot
+				registerCount, addresses: the amount of slots and the byte offset of the address table
+				steps: the executed steps as i64
+				run: returns 0 on hlt or at the end of the code and line+1 of a taken out of bounds jump
+			Programs using int import env.interrupt, which is called with the registers in memory.
+		*/
+		std::vector<std::uint8_t> toWasm()
+		{
+			bool usesInterrupt = std::any_of(operations.begin(), operations.end(), [](const Operation &operation) { return operation.opcode == Opcode::INT; });
+			auto registerCount = static_cast<std::uint32_t>(addresses.size());
+			auto tableOffset = registerCount * 4;
+			auto pages = std::max<std::uint64_t>((static_cast<std::uint64_t>(tableOffset) * 2 + 0xFFFF) / 0x10000, 1);
+
+			std::vector<std::uint8_t> rtn = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00};
+			std::vector<std::uint8_t> section;
+
+			/* types: () -> i32, () -> () */
+			section = {0x02, 0x60, 0x00, 0x01, 0x7F, 0x60, 0x00, 0x00};
+			writeSection(rtn, 1, section);
+
+			if (usesInterrupt)
+			{
+				section = {0x01};
+				writeName(section, "env");
+				writeName(section, "interrupt");
+				section.insert(section.end(), {0x00, 0x01});
+				writeSection(rtn, 2, section);
+			}
+
+			section = {0x01, 0x00};
+			writeSection(rtn, 3, section);
+
+			section = {0x01, 0x00};
+			writeUnsigned(section, pages);
+			writeSection(rtn, 5, section);
+
+			/* steps, registerCount, addresses */
+			section = {0x03, 0x7E, 0x01, 0x42, 0x00, 0x0B, 0x7F, 0x00, 0x41};
+			writeSigned(section, registerCount);
+			section.insert(section.end(), {0x0B, 0x7F, 0x00, 0x41});
+			writeSigned(section, tableOffset);
+			section.push_back(0x0B);
+			writeSection(rtn, 6, section);
+
+			std::uint32_t run = usesInterrupt ? 1 : 0;
+			section = {0x05};
+			writeName(section, "memory");
+			section.insert(section.end(), {0x02, 0x00});
+			writeName(section, "run");
+			section.push_back(0x00);
+			writeUnsigned(section, run);
+			writeName(section, "steps");
+			section.insert(section.end(), {0x03, 0x00});
+			writeName(section, "registerCount");
+			section.insert(section.end(), {0x03, 0x01});
+			writeName(section, "addresses");
+			section.insert(section.end(), {0x03, 0x02});
+			writeSection(rtn, 7, section);
+
+			auto body = getWasmBody(0);
+			section = {0x01};
+			writeUnsigned(section, body.size());
+			section.insert(section.end(), body.begin(), body.end());
+			writeSection(rtn, 10, section);
+
+			if (registerCount)
+			{
+				section = {0x01, 0x00, 0x41};
+				writeSigned(section, tableOffset);
+				section.push_back(0x0B);
+				writeUnsigned(section, tableOffset);
+				for (auto address : addresses)
+				{
+					for (int i = 0; 4 > i; i++)
+					{
+						section.push_back(static_cast<std::uint8_t>(address >> (i * 8)));
+					}
+				}
+				writeSection(rtn, 11, section);
+			}
+
+			return rtn;
+		}
+	};
+} // namespace EasyBonsai
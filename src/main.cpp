@@ -1,10 +1,19 @@
 #include <map>
+#include <atomic>
+#include <cstdlib>
 #include <chrono>
+#include <regex>
 #include <fstream>
 #include <iostream>
 #include "Console.h"
 #include "Compiler.h"
 #include "Executor.h"
+#include "Transpiler.h"
+#ifndef BONSAI_WEB
+#include "Batch.h"
+#include "Cache.h"
+#include "SelfTest.h"
+#endif
 #include <filesystem>
 #include "belegpp/belegpp.h"
 
@@ -61,20 +70,118 @@ auto run(std::vector<std::string> _code, std::vector<std::uint32_t> usedRegister
 
 	return Result{true, result, {}};
 }
+/*
+	Runs a program in slices, so the page can keep rendering while it is running.
+*/
+struct Session
+{
+	bool loaded;
+	EasyBonsai::Executor executor;
+	EasyBonsai::RunResult state{EasyBonsai::RunStatus::Exhausted, 0, 0};
+
+	Session(std::vector<std::string> _code, std::vector<std::uint32_t> usedRegisters)
+	{
+		loaded = executor.load(_code);
+		for (int i = 0; loaded && usedRegisters.size() > i; i++)
+		{
+			executor.setRegister(i, usedRegisters[i]);
+		}
+		if (!loaded)
+			state.status = EasyBonsai::RunStatus::Error;
+	}
+	/*
+		0: halted, 1: the budget was used up, 2: error
+	*/
+	int runFor(double steps)
+	{
+		if (loaded)
+			state = executor.runFor(static_cast<std::uint64_t>(steps));
+
+		return static_cast<int>(state.status);
+	}
+	std::uint32_t getIp()
+	{
+		return state.ip;
+	}
+	double getSteps()
+	{
+		return static_cast<double>(state.steps);
+	}
+	std::vector<std::string> getResult()
+	{
+		if (state.status == EasyBonsai::RunStatus::Error)
+			return executor.getErrorstack();
+
+		std::vector<std::string> result;
+		for (auto &element : executor.getRegisters())
+		{
+			result.push_back("[$" + std::to_string(element.first) + "]: " + std::to_string(element.second));
+		}
+		return result;
+	}
+};
+auto emitWasm(std::vector<std::string> _code)
+{
+	auto executor = EasyBonsai::Executor();
+	if (!executor.load(_code))
+		return std::vector<std::uint8_t>{};
+
+	return EasyBonsai::Transpiler(executor.getOperations(), executor.getAddresses()).toWasm();
+}
 EMSCRIPTEN_BINDINGS(mygetcode)
 {
 	emscripten::class_<Result>("Result")
 		.function("getSuccess", &Result::getSuccess)
 		.function("getResult", &Result::getResult)
 		.function("getRegisters", &Result::getRegisters);
+	emscripten::class_<Session>("Session")
+		.constructor<std::vector<std::string>, std::vector<std::uint32_t>>()
+		.function("runFor", &Session::runFor)
+		.function("getIp", &Session::getIp)
+		.function("getSteps", &Session::getSteps)
+		.function("getResult", &Session::getResult);
 	emscripten::register_vector<std::string>("StringList");
 	emscripten::register_vector<std::uint32_t>("UIntList");
+	emscripten::register_vector<std::uint8_t>("ByteList");
 	emscripten::function("compile", &compile);
 	emscripten::function("run", &run);
+	emscripten::function("emitWasm", &emitWasm);
 }
 #endif
 
 #ifndef BONSAI_WEB
+#ifdef BONSAI_COUNT_ALLOCATIONS
+/*
+	Builds with BONSAI_COUNT_ALLOCATIONS count every allocation of the program, --benchmark then prints the ones a compile run needed.
+	Counting costs an atomic increment per allocation, so other builds keep the default operator new.
+*/
+static std::atomic<std::uint64_t> allocations{0};
+void *operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (auto rtn = std::malloc(size ? size : 1))
+		return rtn;
+
+	throw std::bad_alloc();
+}
+/* GCC takes the free in here for one that belongs to a new, since new is replaced as well that is fine */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+void operator delete(void *pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
 inline std::vector<std::string> readFileToVector(const std::string &filename)
 {
 	std::vector<std::string> result;
@@ -89,45 +196,111 @@ inline std::vector<std::string> readFileToVector(const std::string &filename)
 	return result;
 }
 
-int main(int argc, char **cargs)
+inline std::uint64_t stepsPerSecond(std::uint64_t steps, std::chrono::high_resolution_clock::duration duration)
 {
-	std::map<std::string, std::string> args;
+	auto seconds = std::chrono::duration<double>(duration).count();
+	if (seconds <= 0)
+		return 0;
 
-	if (argc <= 1)
+	return static_cast<std::uint64_t>(steps / seconds);
+}
+
+/*
+	Writes the translations --emit-c and --emit-wasm ask for, operations and addresses are the ones of a loaded executor.
+*/
+inline void emitTranslations(std::map<std::string, std::string> &args, const std::vector<EasyBonsai::Operation> &operations, const std::vector<std::uint32_t> &addresses)
+{
+	if (args | containsKey("emit-c"))
 	{
-		Console::error << "Too few arguments provided" << Console::endl;
+		auto cFile = !args["emit-c"] ? std::string("output.c") : args["emit-c"];
+		Console::info << "Writing C translation to " << cFile << Console::endl;
+
+		std::ofstream translation(cFile);
+		translation << EasyBonsai::Transpiler(operations, addresses).toC();
+		translation.close();
+	}
+
+	if (args | containsKey("emit-wasm"))
+	{
+		auto wasmFile = !args["emit-wasm"] ? std::string("output.wasm") : args["emit-wasm"];
+		Console::info << "Writing WebAssembly module to " << wasmFile << Console::endl;
+
+		auto module = EasyBonsai::Transpiler(operations, addresses).toWasm();
+		std::ofstream translation(wasmFile, std::ios::binary);
+		translation.write(reinterpret_cast<const char *>(module.data()), module.size());
+		translation.close();
+	}
+}
+
+/*
+	Runs the code in args["run"] with registers of the given type, everything --run does happens here.
+*/
+template <typename Register> int runCode(std::map<std::string, std::string> &args)
+{
+	EasyBonsai::BasicExecutor<Register> executor;
+	if (!std::filesystem::exists(args["run"]))
+	{
+		Console::error << "Sepcified file not found" << Console::endl;
 		return 1;
 	}
 
-	for (int i = 1; argc > i; i++)
+	Console::info << "Running " << args["run"] << Console::endl;
+
+	/*
+		Binary programs are mapped and decoded from their records, their text is only restored for the profile.
+	*/
+	std::vector<std::string> input;
+	EasyBonsai::MappedFile mapped;
+	bool loaded = false;
+	if (mapped.open(args["run"]) && EasyBonsai::BinaryProgram::isBinary(mapped.getData(), mapped.getSize()))
 	{
-		std::string currentArg(cargs[i]);
-		if (currentArg | startsWith("--"))
+		auto program = EasyBonsai::BinaryProgram::parse(mapped.getData(), mapped.getSize());
+		if (!program)
 		{
-			if (argc > (i + 1) && !(cargs[i + 1] | startsWith("--")))
-			{
-				args.insert({currentArg.substr(2), cargs[i + 1]});
-			}
-			else
-			{
-				args.insert({currentArg.substr(2), ""});
-			}
+			Console::error << "Binary program is corrupted or was written by a different version" << Console::endl;
+			return 1;
 		}
+
+		loaded = executor.load(*program);
+		if (args | containsKey("profile"))
+			input = EasyBonsai::disassemble(*program);
+	}
+	else
+	{
+		input = readFileToVector(args["run"]);
+		loaded = executor.load(input);
 	}
 
-	if (args | containsKey("run"))
+	if (!loaded)
 	{
-		EasyBonsai::Executor executor;
-		if (!std::filesystem::exists(args["run"]))
+		for (auto err : executor.getErrorstack())
 		{
-			Console::error << "Sepcified file not found" << Console::endl;
-			return 1;
+			Console::error << err << Console::endl;
 		}
+		return 1;
+	}
 
-		Console::info << "Running " << args["run"] << Console::endl;
+	/* The translations work on 32 bit registers, like the default --width */
+	if ((args | containsKey("emit-c")) || (args | containsKey("emit-wasm")))
+	{
+		if (sizeof(Register) != sizeof(std::uint32_t))
+		{
+			Console::error << "--emit-c and --emit-wasm need 32 bit registers" << Console::endl;
+			return 1;
+		}
+		emitTranslations(args, executor.getOperations(), executor.getAddresses());
+	}
 
-		auto input = readFileToVector(args["run"]);
-		if (!executor.load(input))
+	if (args | containsKey("hints"))
+	{
+		auto hintsFile = !args["hints"] ? args["run"] + ".hints" : args["hints"];
+		auto hints = EasyBonsai::parseHints(readFileToVector(hintsFile));
+		if (!hints)
+		{
+			Console::error << "Failed to read hints from " << hintsFile << Console::endl;
+			return 1;
+		}
+		if (!executor.useHints(*hints))
 		{
 			for (auto err : executor.getErrorstack())
 			{
@@ -135,64 +308,458 @@ int main(int argc, char **cargs)
 			}
 			return 1;
 		}
+		Console::info << "Using " << hints->macros.size() << " macro hints from " << hintsFile << Console::endl;
+	}
 
-		if (args | containsKey("setVars"))
+	if (args | containsKey("setVars"))
+	{
+		auto setVars = args["setVars"];
+		if (!(setVars | contains(":")))
 		{
-			auto setVars = args["setVars"];
-			if (!(setVars | contains(":")))
-			{
-				Console::error << "Invalid setVars format" << Console::endl;
-				return 1;
-			}
-			if (setVars | contains(","))
+			Console::error << "Invalid setVars format" << Console::endl;
+			return 1;
+		}
+		if (setVars | contains(","))
+		{
+			for (auto var : (setVars | split(",")))
 			{
-				for (auto var : (setVars | split(",")))
+				if (var | contains(":"))
 				{
-					if (var | contains(":"))
+					auto splitted = var | split(":");
+					if (std::regex_match(splitted[0], std::regex(R"r(-?[0-9]+)r")) && std::regex_match(splitted[1], std::regex(R"r(-?[0-9]+)r")))
 					{
-						auto splitted = var | split(":");
-						if (std::regex_match(splitted[0], std::regex(R"r(-?[0-9]+)r")) && std::regex_match(splitted[1], std::regex(R"r(-?[0-9]+)r")))
-						{
-							Console::debug << "Setting Register $" << splitted[0] << " to " << splitted[1] << Console::endl;
-							executor.setRegister(std::stoi(splitted[0]), std::stoi(splitted[1]));
-						}
+						Console::debug << "Setting Register $" << splitted[0] << " to " << splitted[1] << Console::endl;
+						executor.setRegister(static_cast<std::uint32_t>(std::stoul(splitted[0])), static_cast<Register>(std::stoull(splitted[1])));
 					}
 				}
 			}
-			else
+		}
+		else
+		{
+			auto splitted = setVars | split(":");
+			if (std::regex_match(splitted[0], std::regex(R"r(-?[0-9]+)r")) && std::regex_match(splitted[1], std::regex(R"r(-?[0-9]+)r")))
+			{
+				Console::debug << "Setting Register $" << splitted[0] << " to " << splitted[1] << Console::endl;
+				executor.setRegister(static_cast<std::uint32_t>(std::stoul(splitted[0])), static_cast<Register>(std::stoull(splitted[1])));
+			}
+		}
+	}
+
+	if (args | containsKey("batch"))
+	{
+		/*
+			The first line names the registers, every following line is one input.
+		*/
+		auto lines = readFileToVector(args["batch"]);
+		if (lines.empty())
+		{
+			Console::error << "Batch file is empty" << Console::endl;
+			return 1;
+		}
+
+		auto parseRow = [](const std::string &line) {
+			std::vector<std::uint64_t> rtn;
+			for (auto cell : ((line | replace("$", "")) | split(",")))
+			{
+				cell = cell | trim();
+				rtn.push_back(std::regex_match(cell, std::regex(R"r(-?[0-9]+)r")) ? static_cast<std::uint64_t>(std::stoull(cell)) : 0);
+			}
+			return rtn;
+		};
+
+		auto columns = parseRow(lines[0]);
+		std::vector<std::uint32_t> inputColumns(columns.begin(), columns.end());
+		std::vector<std::vector<Register>> inputs;
+		for (std::size_t i = 1; lines.size() > i; i++)
+		{
+			if (!(lines[i] | trim()).empty())
+			{
+				auto row = parseRow(lines[i]);
+				inputs.emplace_back(row.begin(), row.end());
+			}
+		}
+
+		auto threads = (args | containsKey("threads")) ? std::stoul(args["threads"]) : std::thread::hardware_concurrency();
+		EasyBonsai::BasicBatch<Register> batch(executor, threads);
+
+		if (args | containsKey("benchmark"))
+		{
+			std::vector<std::pair<std::string, std::size_t>> modes = {{"Scalar", 0}, {"Lockstep 8", 8}, {"Lockstep 16", 16}};
+			for (auto &mode : modes)
 			{
-				auto splitted = setVars | split(":");
-				if (std::regex_match(splitted[0], std::regex(R"r(-?[0-9]+)r")) && std::regex_match(splitted[1], std::regex(R"r(-?[0-9]+)r")))
+				batch.setLockstep(mode.second);
+
+				auto start_time = std::chrono::high_resolution_clock::now();
+				auto results = batch.run(inputColumns, inputs);
+				auto end_time = std::chrono::high_resolution_clock::now();
+
+				std::uint64_t totalSteps = 0;
+				for (const auto &result : results)
 				{
-					Console::debug << "Setting Register $" << splitted[0] << " to " << splitted[1] << Console::endl;
-					executor.setRegister(std::stoi(splitted[0]), std::stoi(splitted[1]));
+					totalSteps += result.steps;
 				}
+				Console::info << mode.first << " run: " << totalSteps << " steps in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms (" << stepsPerSecond(totalSteps, end_time - start_time) << " steps/s)" << Console::endl;
+			}
+		}
+
+		if (args | containsKey("lockstep"))
+		{
+			auto lanes = !args["lockstep"] ? 8 : std::stoul(args["lockstep"]);
+			if (lanes != 8 && lanes != 16)
+			{
+				Console::error << "Lockstep supports 8 or 16 lanes" << Console::endl;
+				return 1;
 			}
+			batch.setLockstep(lanes);
+			Console::info << "Running " << lanes << " inputs at once using " << EasyBonsai::Lockstep<8, Register>::getKernel() << Console::endl;
 		}
+		Console::info << "Running " << inputs.size() << " inputs on " << std::min<std::size_t>(threads ? threads : 1, inputs.size()) << " threads" << Console::endl;
 
 		auto start_time = std::chrono::high_resolution_clock::now();
-		auto executionSuccess = executor.run();
+		auto results = batch.run(inputColumns, inputs);
 		auto end_time = std::chrono::high_resolution_clock::now();
 
-		if (!executionSuccess)
+		std::uint64_t totalSteps = 0;
+		auto outputColumns = batch.getColumns(inputColumns);
+		auto resultFile = !args["batch-output"] ? args["batch"] + ".results.csv" : args["batch-output"];
+
+		std::ofstream output(resultFile);
+		output << "input,status,steps";
+		for (auto address : outputColumns)
 		{
-			for (auto err : executor.getErrorstack())
+			output << ",$" << address;
+		}
+		output << "\n";
+
+		for (std::size_t i = 0; results.size() > i; i++)
+		{
+			const auto &result = results[i];
+			totalSteps += result.steps;
+
+			output << i << "," << (result.success ? "ok" : "Jmp Destination out of bounds in line " + std::to_string(result.trap)) << "," << result.steps;
+			for (auto value : result.registers)
 			{
-				Console::error << err << Console::endl;
+				output << "," << static_cast<std::uint64_t>(value);
 			}
-			return 1;
+			output << "\n";
+		}
+		output.close();
+
+		Console::info << "Batch finished in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms!" << Console::endl;
+		Console::info << "Executed " << totalSteps << " steps (" << stepsPerSecond(totalSteps, end_time - start_time) << " steps/s)" << Console::endl;
+		Console::info << "Results written to " << resultFile << Console::endl;
+		return 0;
+	}
+
+	if (args | containsKey("reference"))
+	{
+		executor.setMode(EasyBonsai::ExecutionMode::Reference);
+	}
+	else if (args | containsKey("decoded"))
+	{
+		executor.setMode(EasyBonsai::ExecutionMode::Decoded);
+	}
+	else if (args | containsKey("jit"))
+	{
+		if (!EasyBonsai::Jit<Register>::isSupported())
+		{
+			Console::error << "The jit is only available on x86-64, falling back to the interpreter" << Console::endl;
+		}
+		executor.setMode(EasyBonsai::ExecutionMode::Jit);
+	}
+
+	if (args | containsKey("benchmark"))
+	{
+		std::vector<std::pair<std::string, EasyBonsai::ExecutionMode>> modes = {{"Reference", EasyBonsai::ExecutionMode::Reference}, {"Decoded", EasyBonsai::ExecutionMode::Decoded}, {"Threaded", EasyBonsai::ExecutionMode::Threaded}, {"Jit", EasyBonsai::ExecutionMode::Jit}};
+		for (auto &mode : modes)
+		{
+			auto benchmark = executor;
+			benchmark.setMode(mode.second);
+
+			auto start_time = std::chrono::high_resolution_clock::now();
+			benchmark.run();
+			auto end_time = std::chrono::high_resolution_clock::now();
+
+			Console::info << mode.first << " run: " << benchmark.getSteps() << " steps in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms (" << stepsPerSecond(benchmark.getSteps(), end_time - start_time) << " steps/s)" << Console::endl;
+		}
+	}
+
+	if (args | containsKey("profile"))
+	{
+		executor.setProfiling(true);
+	}
+	if (args | containsKey("detect-cycles"))
+	{
+		executor.setCycleDetection(true);
+	}
+
+	EasyBonsai::Debugger debugger;
+	if (args | containsKey("watch"))
+	{
+		for (auto spec : (args["watch"] | split(",")))
+		{
+			auto watchpoint = EasyBonsai::parseWatchpoint(spec);
+			if (!watchpoint)
+			{
+				Console::error << "Invalid watchpoint \"" << spec << "\"" << Console::endl;
+				return 1;
+			}
+			debugger.addWatchpoint(*watchpoint);
+		}
+	}
+	if (args | containsKey("break"))
+	{
+		for (auto spec : (args["break"] | split(",")))
+		{
+			auto breakpoint = EasyBonsai::parseBreakpoint(spec);
+			if (!breakpoint)
+			{
+				Console::error << "Invalid breakpoint \"" << spec << "\"" << Console::endl;
+				return 1;
+			}
+			debugger.addBreakpoint(*breakpoint);
+		}
+	}
+	if (!debugger.getWatchpoints().empty() || !debugger.getBreakpoints().empty())
+	{
+		executor.setDebugger(&debugger);
+	}
+
+	auto isTracing = args | containsKey("trace");
+	auto traceFile = (isTracing && !args["trace"].empty()) ? args["trace"] : args["run"] + ".trace";
+	auto traceSize = (args | containsKey("trace-size")) ? std::stoul(args["trace-size"]) : 1 << 16;
+	EasyBonsai::TraceBuffer trace(isTracing ? static_cast<std::uint32_t>(traceSize) : 1);
+	if (isTracing)
+	{
+		executor.setTrace(&trace);
+		trace.dumpOnSignals(traceFile);
+	}
+
+	auto start_time = std::chrono::high_resolution_clock::now();
+	auto executionSuccess = true;
+	std::optional<EasyBonsai::RunResult> stoppedEarly;
+	if (args | containsKey("max-steps") || args | containsKey("timeout") || args | containsKey("checkpoint-every") || args | containsKey("resume"))
+	{
+		/*
+			Runs in slices, so the timeout is checked every few milliseconds and checkpoints can be taken in between.
+			The reference mode and the JIT can not stop in between, the threaded mode runs their slices.
+		*/
+		if (args | containsKey("reference") || args | containsKey("jit"))
+			Console::error << "--max-steps, --timeout, --checkpoint-every and --resume can not stop " << ((args | containsKey("reference")) ? "--reference" : "--jit") << " runs, using the threaded mode instead" << Console::endl;
+
+		std::uint64_t maxSteps = (args | containsKey("max-steps")) ? std::stoull(args["max-steps"]) : std::numeric_limits<std::uint64_t>::max();
+		auto timeout = (args | containsKey("timeout")) ? std::chrono::duration<double>(std::stod(args["timeout"])) : std::chrono::duration<double>::max();
+		std::uint64_t checkpointEvery = (args | containsKey("checkpoint-every")) ? std::stoull(args["checkpoint-every"]) : 0;
+		auto checkpointFile = !args["checkpoint"] ? args["run"] + ".checkpoint" : args["checkpoint"];
+
+		if (args | containsKey("resume"))
+		{
+			auto checkpoint = EasyBonsai::readCheckpoint(!args["resume"] ? checkpointFile : args["resume"]);
+			if (!checkpoint)
+			{
+				Console::error << "Failed to read checkpoint" << Console::endl;
+				return 1;
+			}
+			if (!executor.restore(*checkpoint))
+			{
+				for (auto err : executor.getErrorstack())
+				{
+					Console::error << err << Console::endl;
+				}
+				return 1;
+			}
+			Console::info << "Resuming at line " << checkpoint->ip << " after " << checkpoint->steps << " steps" << Console::endl;
+		}
+
+		auto nextCheckpoint = executor.getSteps() + checkpointEvery;
+		EasyBonsai::RunResult result;
+		do
+		{
+			std::uint64_t budget = std::min<std::uint64_t>(maxSteps - std::min<std::uint64_t>(executor.getSteps(), maxSteps), 1 << 24);
+			if (checkpointEvery)
+				budget = std::min<std::uint64_t>(budget, nextCheckpoint - std::min<std::uint64_t>(executor.getSteps(), nextCheckpoint));
+
+			result = executor.runFor(budget);
+			if (checkpointEvery && result.status == EasyBonsai::RunStatus::Exhausted && executor.getSteps() >= nextCheckpoint)
+			{
+				if (!EasyBonsai::writeCheckpoint(checkpointFile, executor.getCheckpoint()))
+					Console::error << "Failed to write checkpoint to " << checkpointFile << Console::endl;
+
+				nextCheckpoint = executor.getSteps() + checkpointEvery;
+			}
+		} while (result.status == EasyBonsai::RunStatus::Exhausted && maxSteps > executor.getSteps() && std::chrono::high_resolution_clock::now() - start_time < timeout);
+
+		executionSuccess = result.status != EasyBonsai::RunStatus::Error;
+		if (result.status == EasyBonsai::RunStatus::Exhausted)
+			stoppedEarly = result;
+	}
+	else if (args | containsKey("cache") && !(args | containsKey("profile")) && !isTracing && !(args | containsKey("detect-cycles")) && !(args | containsKey("watch")) && !(args | containsKey("break")))
+	{
+		/*
+			Only halted runs are cached, profiling, tracing, cycle detection and debugging always need the code to run.
+		*/
+		EasyBonsai::ResultCache cache(!args["cache"] ? ".bonsai-cache" : args["cache"], (args | containsKey("cache-size")) ? std::stoull(args["cache-size"]) << 20 : 64ull << 20);
+		auto start = executor.getCheckpoint();
+
+		std::optional<EasyBonsai::Checkpoint> cached;
+		if (!(args | containsKey("no-cache")))
+			cached = cache.load(start);
+
+		if (cached && executor.restore(*cached))
+		{
+			Console::info << "Using the cached result" << Console::endl;
+		}
+		else
+		{
+			executionSuccess = executor.run();
+			if (executionSuccess && !cache.store(start, executor.getCheckpoint()))
+				Console::error << "Failed to write the result into the cache" << Console::endl;
+		}
+	}
+	else
+	{
+		executionSuccess = executor.run();
+	}
+	auto end_time = std::chrono::high_resolution_clock::now();
+
+	if (isTracing)
+	{
+		trace.stopDumpOnSignals();
+		Console::info << "Writing the last " << std::min(trace.getWritten(), trace.getCapacity()) << " of " << trace.getWritten() << " register writes to " << traceFile << Console::endl;
+
+		auto dump = trace.serialize();
+		std::ofstream output(traceFile, std::ios::binary);
+		output.write(reinterpret_cast<const char *>(dump.data()), dump.size());
+		output.close();
+	}
+
+	if (args | containsKey("profile"))
+	{
+		const auto &profile = executor.getProfile();
+		auto hotspots = EasyBonsai::getHotspots(profile);
+		auto seconds = std::chrono::duration<double>(end_time - start_time).count();
+
+		Console::info << "Profiled " << executor.getSteps() << " steps (" << stepsPerSecond(executor.getSteps(), end_time - start_time) << " steps/s), hotspots:" << Console::endl;
+		for (std::size_t i = 0; hotspots.size() > i && 10 > i; i++)
+		{
+			auto line = hotspots[i];
+			auto share = executor.getSteps() ? 100.0 * profile.executions[line] / executor.getSteps() : 0;
+			std::string outcome = profile.isTest[line] ? printfs(" (taken %llu, not taken %llu)", static_cast<unsigned long long>(profile.taken[line]), static_cast<unsigned long long>(profile.executions[line] - profile.taken[line])) : "";
+			Console::info << printfs("%6u: %-12s %14llu %6.2f%%", static_cast<unsigned>(line), input[line].c_str(), static_cast<unsigned long long>(profile.executions[line]), share) << outcome << Console::endl;
+		}
+
+		auto profileFile = !args["profile"] ? args["run"] + ".profile.json" : args["profile"];
+		Console::info << "Writing profile to " << profileFile << Console::endl;
+
+		std::ofstream output(profileFile);
+		output << EasyBonsai::serializeProfile(profile, input, executor.getSteps(), seconds);
+		output.close();
+	}
+
+	if (!executionSuccess)
+	{
+		for (auto err : executor.getErrorstack())
+		{
+			Console::error << err << Console::endl;
 		}
+		return 1;
+	}
 
+	if (stoppedEarly)
+	{
+		Console::error << "Execution stopped at line " << stoppedEarly->ip << " after " << stoppedEarly->steps << " steps, " << (args | containsKey("max-steps") && stoppedEarly->steps >= std::stoull(args["max-steps"]) ? "the step limit was reached" : "the timeout was reached") << Console::endl;
+	}
+	else
+	{
 		Console::info << "Execution finished in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms!" << Console::endl;
+	}
+	Console::info << "Executed " << executor.getSteps() << " steps (" << stepsPerSecond(executor.getSteps(), end_time - start_time) << " steps/s)" << Console::endl;
 
-		Console::info << "Registers after execution: " << Console::endl;
-		for (auto reg : executor.getRegisters())
+	Console::info << "Registers after execution: " << Console::endl;
+	for (auto reg : executor.getRegisters())
+	{
+		Console::info << "[$" << reg.first << "]: " << static_cast<std::uint64_t>(reg.second) << Console::endl;
+	}
+
+	return stoppedEarly ? 1 : 0;
+}
+
+int main(int argc, char **cargs)
+{
+	std::map<std::string, std::string> args;
+
+	if (argc <= 1)
+	{
+		Console::error << "Too few arguments provided" << Console::endl;
+		return 1;
+	}
+
+	for (int i = 1; argc > i; i++)
+	{
+		std::string currentArg(cargs[i]);
+		if (currentArg | startsWith("--"))
+		{
+			if (argc > (i + 1) && !(cargs[i + 1] | startsWith("--")))
+			{
+				args.insert({currentArg.substr(2), cargs[i + 1]});
+			}
+			else
+			{
+				args.insert({currentArg.substr(2), ""});
+			}
+		}
+	}
+
+	if (args | containsKey("decode-trace"))
+	{
+		std::ifstream dump(args["decode-trace"], std::ios::binary);
+		auto records = EasyBonsai::decodeTrace(std::vector<std::uint8_t>(std::istreambuf_iterator<char>(dump), {}));
+		if (!records)
 		{
-			Console::info << "[$" << reg.first << "]: " << reg.second << Console::endl;
+			Console::error << "Failed to read trace from " << args["decode-trace"] << Console::endl;
+			return 1;
 		}
 
+		for (const auto &record : *records)
+		{
+			std::cout << record << std::endl;
+		}
 		return 0;
 	}
+
+	if (args | containsKey("selftest"))
+	{
+		std::size_t checks = 0;
+		auto failures = EasyBonsai::runSelfTest(checks);
+		for (const auto &failure : failures)
+		{
+			Console::error << failure << Console::endl;
+		}
+
+		if (!failures.empty())
+		{
+			Console::error << failures.size() << " of " << checks << " checks failed" << Console::endl;
+			return 1;
+		}
+		Console::info << "All " << checks << " checks passed" << Console::endl;
+		return 0;
+	}
+
+	if (args | containsKey("run"))
+	{
+		auto width = (args | containsKey("width")) ? args["width"] : "32";
+		if (width == "8")
+			return runCode<std::uint8_t>(args);
+		if (width == "16")
+			return runCode<std::uint16_t>(args);
+		if (width == "32")
+			return runCode<std::uint32_t>(args);
+		if (width == "64")
+			return runCode<std::uint64_t>(args);
+
+		Console::error << "Registers can be 8, 16, 32 or 64 bit wide" << Console::endl;
+		return 1;
+	}
 	else if (!(args | containsKey("input")))
 	{
 		Console::error << "No input specified" << Console::endl;
@@ -264,9 +831,80 @@ int main(int argc, char **cargs)
 	Console::info << "Additional defined registers: " << (additionalRegisters | join(", ")) << Console::endl;
 	Console::info << "Compilation finished in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms!" << Console::endl;
 
-	std::ofstream output(args["output"]);
-	output << (result.second | join("\n"));
-	output.close();
+	if (args | containsKey("benchmark"))
+	{
+		/* A compiler keeps the labels and variables it has seen, so every run needs a new one */
+		for (int run = 1; 5 >= run; run++)
+		{
+			auto benchmark = EasyBonsai::Compiler();
+
+#ifdef BONSAI_COUNT_ALLOCATIONS
+			auto start_allocations = allocations.load();
+#endif
+			auto start_time = std::chrono::high_resolution_clock::now();
+			auto compiled = benchmark.compile(input, preDefinedVars);
+			auto end_time = std::chrono::high_resolution_clock::now();
+
+			std::string allocationCount;
+#ifdef BONSAI_COUNT_ALLOCATIONS
+			allocationCount = ", " + std::to_string(allocations.load() - start_allocations) + " allocations";
+#endif
+
+			Console::info << "Compile run " << run << ": " << input.size() << " lines into " << compiled.second.size() << " lines in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms (" << stepsPerSecond(input.size(), end_time - start_time) << " lines/s" << allocationCount << ")" << Console::endl;
+		}
+
+		/* The recognizer alone, on the lines the compiler reads and the ones it writes */
+		std::vector<std::string> lines(input.begin(), input.end());
+		lines.insert(lines.end(), result.second.begin(), result.second.end());
+		for (int run = 1; 5 >= run; run++)
+		{
+			std::uint64_t recognized = 0;
+
+			auto start_time = std::chrono::high_resolution_clock::now();
+			for (int pass = 0; 10 > pass; pass++)
+				for (const auto &line : lines)
+					if (EasyBonsai::easyBonsaiInstructions.matchesAny(line) || EasyBonsai::bonsaiInstructions.matchesAny(line))
+						recognized++;
+			auto end_time = std::chrono::high_resolution_clock::now();
+
+			Console::info << "Recognizer run " << run << ": " << recognized / 10 << " of " << lines.size() << " lines recognized, " << lines.size() * 10 << " lines in " << (end_time - start_time) / std::chrono::milliseconds(1) << "ms (" << stepsPerSecond(lines.size() * 10, end_time - start_time) << " lines/s)" << Console::endl;
+		}
+	}
+
+	if (std::filesystem::path(args["output"]).extension() == ".bonb")
+	{
+		EasyBonsai::Executor executor;
+		executor.load(result.second);
+
+		const auto &operations = executor.getOperations();
+		auto binary = EasyBonsai::serializeBinary(executor.getProgramHash(), executor.getAddresses(), {operations.begin(), operations.begin() + result.second.size()});
+		std::ofstream output(args["output"], std::ios::binary);
+		output.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+		output.close();
+	}
+	else
+	{
+		std::ofstream output(args["output"]);
+		output << (result.second | join("\n"));
+		output.close();
+	}
+
+	if ((args | containsKey("emit-c")) || (args | containsKey("emit-wasm")))
+	{
+		EasyBonsai::Executor executor;
+		executor.load(result.second);
+		emitTranslations(args, executor.getOperations(), executor.getAddresses());
+	}
+
+	if (args | containsKey("hints"))
+	{
+		auto hintsFile = !args["hints"] ? args["output"] + ".hints" : args["hints"];
+		Console::info << "Writing macro hints to " << hintsFile << Console::endl;
+
+		std::ofstream hints(hintsFile);
+		hints << (EasyBonsai::serializeHints(compiler.getHints()) | join("\n"));
+		hints.close();
+	}
 
 	return 0;
 }
@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+#
+#	Compiles every program in test/programs, runs it with --run and compares the registers with the ones of its C translation.
+#	The steps and registers of its WebAssembly module are compared as well, test/wasm.js runs the module with node.
+#	The first line of a program is a comment with the setVars it is run with.
+#
+#	Usage: test/translations.sh ./EasyBonsai3-Linux
+#
+set -e
+
+bonsai=$(realpath "$1")
+tests=$(dirname "$0")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+registers()
+{
+	sed 's/\x1b\[[0-9;]*m//g' | grep -o '\[\$[0-9]*\]: [0-9]*'
+}
+steps()
+{
+	sed 's/\x1b\[[0-9;]*m//g' | grep -o 'Executed [0-9]* steps'
+}
+
+failed=0
+for program in "$tests"/programs/*.bon; do
+	name=$(basename "$program" .bon)
+	vars=$(sed -n '1s/^; setVars //p' "$program")
+
+	"$bonsai" --input "$program" --output "$work/$name.bon" --emit-c "$work/$name.c" --emit-wasm "$work/$name.wasm" > /dev/null
+	"$bonsai" --run "$work/$name.bon" --setVars "$vars" > "$work/$name.log"
+	registers < "$work/$name.log" > "$work/$name.run"
+	if [ ! -s "$work/$name.run" ]; then
+		echo "$name: --run printed no registers"
+		failed=1
+		continue
+	fi
+
+	cc -O2 "$work/$name.c" -o "$work/$name"
+	"$work/$name" --setVars "$vars" | registers > "$work/$name.c.run"
+	if ! diff "$work/$name.run" "$work/$name.c.run"; then
+		echo "$name: the C translation ends with different registers than --run"
+		failed=1
+	fi
+
+	node "$tests/wasm.js" "$work/$name.wasm" "$vars" > "$work/$name.wasm.log"
+	if ! diff <(steps < "$work/$name.log"; cat "$work/$name.run") <(steps < "$work/$name.wasm.log"; registers < "$work/$name.wasm.log"); then
+		echo "$name: the WebAssembly module ends with different steps or registers than --run"
+		failed=1
+	fi
+done
+
+if [ "$failed" = 0 ]; then
+	echo "All translations agree with --run"
+fi
+exit $failed
@@ -0,0 +1,33 @@
+/*
+	Runs a module written by --emit-wasm and prints its steps and registers the way --run does.
+	The registers of the setVars argument are written into the memory of the module before run is called.
+
+	Usage: node test/wasm.js output.wasm 0:3,1:7
+*/
+const fs = require('fs');
+
+const [file, vars = ''] = process.argv.slice(2);
+
+WebAssembly.instantiate(fs.readFileSync(file), { env: { interrupt() {} } }).then(({ instance }) => {
+	const { memory, run, steps, registerCount, addresses } = instance.exports;
+	const registers = new Uint32Array(memory.buffer, 0, registerCount.value);
+	const table = new Uint32Array(memory.buffer, addresses.value, registerCount.value);
+
+	for (const variable of vars.split(',').filter((text) => text.includes(':'))) {
+		const [address, value] = variable.split(':').map(Number);
+		const slot = table.indexOf(address);
+		if (slot >= 0)
+			registers[slot] = value;
+	}
+
+	const trap = run();
+	if (trap) {
+		console.error(`Jmp Destination out of bounds in line ${trap}`);
+		process.exit(1);
+	}
+
+	console.log(`Executed ${steps.value} steps`);
+	console.log('Registers after execution: ');
+	for (const slot of [...table.keys()].sort((a, b) => table[a] - table[b]))
+		console.log(`[$${table[slot]}]: ${registers[slot]}`);
+});